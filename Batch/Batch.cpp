@@ -0,0 +1,343 @@
+#include "Batch.h"
+#include "BoundedQueue.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+typedef std::chrono::steady_clock Clock;
+
+// An image on its way through the pipeline. The items are passed around by pointer, so the pixels of an image
+// always have a single owner and the compute stage can change them in place without copying them first.
+struct BatchItem
+{
+	size_t index; // The position of the input in the job
+	Image image;
+	FoldedChain folded;
+};
+
+// What one stage has done. Only the time spent on the images is counted, not the time spent waiting for the queues.
+struct StageCounters
+{
+	std::atomic<size_t> images{ 0 };
+	std::atomic<size_t> bytes{ 0 };
+	std::atomic<long long> busyNanoseconds{ 0 };
+
+	void add(const Image& image, Clock::time_point start)
+	{
+		this->images++;
+		this->bytes += image.getStride() * image.getHeight();
+		this->busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+};
+
+// Reads a count from the rest of a line of the job file
+static bool readCount(const std::string& text, size_t& count)
+{
+	std::istringstream is(text);
+	return (is >> count) && (is >> std::ws).eof();
+}
+
+static void printStage(const char* name, const StageCounters& counters, unsigned threadCount, double wallSeconds)
+{
+	const double megabytes = counters.bytes / 1e6;
+	const double busySeconds = counters.busyNanoseconds / 1e9;
+	// The rate of a single thread while it is working, and the part of the time the threads of the stage were working.
+	// The stage with the highest load is the one that holds the others back.
+	std::cout << std::fixed << std::setprecision(1) << name << ": " << counters.images << " images, " << megabytes << " MB, "
+		<< (busySeconds > 0 ? megabytes / busySeconds : 0.0) << " MB/s and "
+		<< (busySeconds > 0 ? counters.images / busySeconds : 0.0) << " images/s per thread, "
+		<< threadCount << " threads busy " << (wallSeconds > 0 ? 100 * busySeconds / (threadCount * wallSeconds) : 0.0) << "% of the time\n";
+}
+
+Batch::Batch(const std::string& jobFilePath)
+{
+	std::ifstream is(jobFilePath);
+	if (!is)
+	{
+		std::cout << "Could not open file " << jobFilePath << "\n";
+		return;
+	}
+	std::string line;
+	for (unsigned lineNumber = 1; std::getline(is, line); lineNumber++)
+	{
+		if (!readLine(line))
+		{
+			std::cout << "The error is on line " << lineNumber << " of " << jobFilePath << "\n";
+			return;
+		}
+	}
+	if (this->inputs.empty())
+	{
+		std::cout << "The job has no inputs\n";
+		return;
+	}
+	if (this->outputPattern.empty())
+	{
+		std::cout << "The job has no output\n";
+		return;
+	}
+	this->valid = true;
+}
+
+bool Batch::isValid() const
+{
+	return this->valid;
+}
+
+bool Batch::readLine(const std::string& line)
+{
+	std::istringstream words(line);
+	std::string key;
+	if (!(words >> key) || key[0] == '#')
+	{
+		return true;
+	}
+	std::string value;
+	std::getline(words >> std::ws, value);
+	value.erase(value.find_last_not_of(" \t\r") + 1);
+
+	if (key == "input" || key == "output")
+	{
+		if (value.empty())
+		{
+			std::cout << "A file path is missing\n";
+			return false;
+		}
+		if (key == "input")
+		{
+			this->inputs.push_back(value);
+		}
+		else
+		{
+			this->outputPattern = value;
+		}
+		return true;
+	}
+	if (key == "command")
+	{
+		// A crop carries its coordinates on the same line, unlike in a session, where they are given separately
+		std::istringstream is(value);
+		std::string name;
+		unsigned coordinates[4];
+		if ((is >> name) && name == "crop")
+		{
+			for (size_t i = 0; i < 4; i++)
+			{
+				if (!(is >> coordinates[i]) || coordinates[i] > 65535)
+				{
+					std::cout << "A crop needs four coordinates\n";
+					return false;
+				}
+				this->chain.cropInfo.push_back((unsigned short)coordinates[i]);
+			}
+			value = name;
+		}
+		Command command;
+		if (!parseCommand(value, command))
+		{
+			std::cout << "There is no such command\n";
+			return false;
+		}
+		if (command == collageV || command == collageH)
+		{
+			std::cout << "Collages cannot be made in a batch\n";
+			return false;
+		}
+		// Grayscale and monochrome can only be queued once, just like in a session
+		for (size_t i = 0; i < this->chain.commands.size(); i++)
+		{
+			if ((command == grayscale || command == monochrome) && this->chain.commands[i] == command)
+			{
+				std::cout << "There is no such command\n";
+				return false;
+			}
+		}
+		this->chain.commands.push_back(command);
+		return true;
+	}
+	size_t count;
+	if (key == "readers" || key == "workers" || key == "writers" || key == "queue")
+	{
+		// Only the compute stage can be given 0 threads, which means one for every processor core
+		if (!readCount(value, count) || count > 1024 || (count == 0 && key != "workers"))
+		{
+			std::cout << "Invalid count " << value << "\n";
+			return false;
+		}
+		if (key == "readers")
+		{
+			this->readerCount = (unsigned)count;
+		}
+		else if (key == "workers")
+		{
+			this->workerCount = (unsigned)count;
+		}
+		else if (key == "writers")
+		{
+			this->writerCount = (unsigned)count;
+		}
+		else
+		{
+			this->queueCapacity = count;
+		}
+		return true;
+	}
+	std::cout << "Unknown setting " << key << "\n";
+	return false;
+}
+
+std::string Batch::getOutputPath(size_t index) const
+{
+	const std::string& input = this->inputs[index];
+	const size_t nameStart = input.find_last_of("/\\") + 1; // 0 when the input has no directory
+	size_t extensionStart = input.find_last_of('.');
+	if (extensionStart == std::string::npos || extensionStart < nameStart)
+	{
+		extensionStart = input.length();
+	}
+	const std::string names[] = { "{dir}", "{name}", "{ext}", "{index}" };
+	const std::string values[] = {
+		input.substr(0, nameStart),
+		input.substr(nameStart, extensionStart - nameStart),
+		extensionStart < input.length() ? input.substr(extensionStart + 1) : "",
+		std::to_string(index + 1),
+	};
+	std::string path;
+	for (size_t i = 0; i < this->outputPattern.length(); )
+	{
+		size_t j = 0;
+		while (j < 4 && this->outputPattern.compare(i, names[j].length(), names[j]) != 0)
+		{
+			j++;
+		}
+		if (j < 4)
+		{
+			path += values[j];
+			i += names[j].length();
+		}
+		else
+		{
+			path += this->outputPattern[i++];
+		}
+	}
+	return path;
+}
+
+// Every stage is a thread pool whose threads all run the same loop: take an image from the previous stage, do
+// the work of the stage and pass the image on. A queue is closed when all threads that add to it have finished,
+// and the threads of the next stage finish in turn when they have emptied it.
+bool Batch::run()
+{
+	if (!this->valid)
+	{
+		return false;
+	}
+	BoundedQueue<std::unique_ptr<BatchItem>> loadedImages(this->queueCapacity);
+	BoundedQueue<std::unique_ptr<BatchItem>> processedImages(this->queueCapacity);
+	StageCounters read, processed, written;
+	std::atomic<size_t> nextInput(0);
+	std::atomic<bool> failed(false);
+	const Clock::time_point start = Clock::now();
+
+	ThreadPool readers(this->readerCount);
+	ThreadPool workers(this->workerCount);
+	ThreadPool writers(this->writerCount);
+	std::vector<std::future<void>> readersDone, workersDone, writersDone;
+
+	for (unsigned i = 0; i < readers.getWorkerCount(); i++)
+	{
+		readersDone.push_back(readers.submit([&]()
+		{
+			for (size_t index = nextInput++; index < this->inputs.size(); index = nextInput++)
+			{
+				const Clock::time_point imageStart = Clock::now();
+				std::unique_ptr<BatchItem> item(new BatchItem{ index, Image(), FoldedChain() });
+				item->image.probe(this->inputs[index]);
+				if (item->image.getFilePath() == "")
+				{
+					failed = true;
+					continue;
+				}
+				// The crops are done before loading, so only the area they leave is read
+				item->folded = foldChain(item->image, this->chain, 0);
+				item->image.load();
+				if (!item->image.isLoaded())
+				{
+					failed = true;
+					continue;
+				}
+				// The pixels of a raw file are mapped and would only be read from the disk when the compute stage
+				// touches them. When the chain changes them, they are copied into memory here instead, so the
+				// reading stays in this stage.
+				if (!item->folded.transform.isIdentity() || !item->folded.pointOps.isEmpty())
+				{
+					item->image.getData();
+				}
+				read.add(item->image, imageStart);
+				loadedImages.push(std::move(item));
+			}
+		}));
+	}
+	for (unsigned i = 0; i < workers.getWorkerCount(); i++)
+	{
+		workersDone.push_back(workers.submit([&]()
+		{
+			std::unique_ptr<BatchItem> item;
+			while (loadedImages.pop(item))
+			{
+				const Clock::time_point imageStart = Clock::now();
+				item->image.transform(item->folded.transform);
+				item->image.applyPointOps(item->folded.pointOps);
+				processed.add(item->image, imageStart);
+				processedImages.push(std::move(item));
+			}
+		}));
+	}
+	for (unsigned i = 0; i < writers.getWorkerCount(); i++)
+	{
+		writersDone.push_back(writers.submit([&]()
+		{
+			std::unique_ptr<BatchItem> item;
+			while (processedImages.pop(item))
+			{
+				const Clock::time_point imageStart = Clock::now();
+				if (item->image.saveImage(getOutputPath(item->index)))
+				{
+					written.add(item->image, imageStart);
+				}
+				else
+				{
+					failed = true;
+				}
+				item.reset(); // The pixels are freed before the next image is taken
+			}
+		}));
+	}
+
+	for (size_t i = 0; i < readersDone.size(); i++)
+	{
+		readersDone[i].get();
+	}
+	loadedImages.close();
+	for (size_t i = 0; i < workersDone.size(); i++)
+	{
+		workersDone[i].get();
+	}
+	processedImages.close();
+	for (size_t i = 0; i < writersDone.size(); i++)
+	{
+		writersDone[i].get();
+	}
+	const double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << std::fixed << std::setprecision(2) << "Saved " << written.images << " of " << this->inputs.size()
+		<< " images in " << wallSeconds << " s\n";
+	printStage("Read", read, readers.getWorkerCount(), wallSeconds);
+	printStage("Processed", processed, workers.getWorkerCount(), wallSeconds);
+	printStage("Written", written, writers.getWorkerCount(), wallSeconds);
+	return !failed;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Session.h"
+#include <string>
+#include <vector>
+
+/* Executes one command chain on many images without a user, as described by a job file. A session goes through
+its images one at a time - each of them is read, processed and saved before the next one is started - so the disk
+and the processor take turns. A batch runs the three steps as stages of a pipeline instead: reader threads load
+the images ahead, the compute threads execute the chain and writer threads save the results, and each stage hands
+its images to the next one through a bounded queue. While one image is being processed, the next ones are being
+read and the previous ones written, and the queues keep only a few images in memory at a time.
+
+The job file has one setting per line, and lines starting with '#' are comments:
+	input <path>          An image to process. There can be any number of inputs.
+	command <command>     A command, as it is typed in a session, executed in the order of the lines.
+	                      A crop is followed by its coordinates: command crop <x1> <y1> <x2> <y2>
+	output <pattern>      The path of every result. {dir} is replaced with the directory of the input (with
+	                      the final '/'), {name} with its name without the extension, {ext} with the extension
+	                      without the dot and {index} with the position of the input in the job, starting from 1.
+	                      The result keeps the format of its input, whatever the extension.
+	readers <count>       The number of threads of every stage. The defaults are 2 readers, one compute
+	workers <count>       thread for every processor core and 2 writers.
+	writers <count>
+	queue <count>         The number of images that can wait between two stages (4 by default) */
+
+class Batch
+{
+private:
+	std::vector<std::string> inputs;
+	CommandChain chain;
+	std::string outputPattern;
+	unsigned readerCount = 2;
+	unsigned workerCount = 0; // 0 means one for every processor core
+	unsigned writerCount = 2;
+	size_t queueCapacity = 4;
+	bool valid = false;
+
+public:
+	Batch(const std::string& jobFilePath);
+
+	bool isValid() const;
+	// Processes all inputs and prints the throughput of every stage. Returns false if any image could not
+	// be read or saved.
+	bool run();
+	std::string getOutputPath(size_t index) const; // The path of the result of the input with the given index
+
+private:
+	bool readLine(const std::string& line); // Applies one line of the job file
+};
@@ -0,0 +1,22 @@
+#include "Batch.h"
+#include <iostream>
+
+/* Runs a batch job without the interactive editor, so scripts can process many images with one command:
+	batch <job file>
+It is built from this file together with all other sources except the benchmarks. The exit code is 0 when
+every image was saved. */
+
+int main(int argc, char** argv)
+{
+	if (argc != 2)
+	{
+		std::cout << "Usage: " << argv[0] << " <job file>\n";
+		return 2;
+	}
+	Batch batch(argv[1]);
+	if (!batch.isValid())
+	{
+		return 2;
+	}
+	return batch.run() ? 0 : 1;
+}
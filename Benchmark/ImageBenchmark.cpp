@@ -0,0 +1,311 @@
+#include "Image.h"
+#include "Cpu.h"
+#include "Generator.h"
+#include "Parallel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+/* A standalone program that measures every operation of Image - loading, saving, grayscale, monochrome,
+negative, both rotations, both flips, crop and both collages - on generated images of every format (P1 to P6,
+and P5 and P6 with 16-bit values) in four sizes, from a thumbnail to 100 megapixels. For every measurement it
+prints the time per pixel, the throughput and the peak memory of the process, and it writes all of them to a
+JSON file, one measurement per line. When the JSON file of an earlier run is given, every measurement is compared
+with it and the ones that became more than 10% slower are listed, so the effect of an optimisation can be seen
+and regressions are caught. It is built from this file together with all other sources except the other
+benchmarks and the tools (*Tool.cpp), with every folder of the repository on the include path, for example:
+	g++ -O2 -pthread -IImage -IFormat ... Benchmark/ImageBenchmark.cpp Image/Image.cpp Format/Format.cpp ...
+The optional arguments are the largest size to measure in megapixels (100 by default, 1 measures only the two
+smallest sizes), the JSON file to write (image_benchmark.json by default) and the JSON file of an earlier run. */
+
+struct FileFormat
+{
+	const char* name;
+	int magicNumber; // The digit after the 'P'
+	unsigned short maxValue;
+	const char* extension;
+};
+
+const FileFormat formats[] = {
+	{ "P1", 1, 1, ".pbm" },
+	{ "P2", 2, 255, ".pgm" },
+	{ "P3", 3, 255, ".ppm" },
+	{ "P4", 4, 1, ".pbm" },
+	{ "P5", 5, 255, ".pgm" },
+	{ "P6", 6, 255, ".ppm" },
+	{ "P5-16", 5, 65535, ".pgm" },
+	{ "P6-16", 6, 65535, ".ppm" },
+};
+
+// From a thumbnail to 100 megapixels. The width of the thumbnail is not a multiple of 8, so the bits of its
+// .pbm rows do not fill whole bytes.
+const unsigned sizes[][2] = { { 150, 100 }, { 1000, 1000 }, { 4000, 3000 }, { 10000, 10000 } };
+
+// Every operation is repeated for this long (but at least once), and the fastest run counts
+const double minimumSeconds = 0.3;
+const double regressionRatio = 1.1;
+
+struct Measurement
+{
+	std::string format;
+	unsigned width;
+	unsigned height;
+	std::string operation;
+	unsigned runs;
+	double nsPerPixel;
+	double megabytesPerSecond;
+	double peakMegabytes;
+};
+
+// Writes an image of random pixels in the given format (see Generator) and returns the size of the file in bytes.
+// The seed is fixed, so every run measures the same pixels.
+size_t generateFile(const std::string& filePath, const FileFormat& format, unsigned width, unsigned height)
+{
+	GeneratorOptions options;
+	options.magicNumber = format.magicNumber;
+	options.width = width;
+	options.height = height;
+	options.maxValue = format.maxValue;
+	if (!generateImage(filePath, options))
+	{
+		std::cout << "Could not write file " << filePath << "\n";
+		std::exit(1);
+	}
+	return (size_t)std::ifstream(filePath, std::ios::binary | std::ios::ate).tellg();
+}
+
+// The peak memory of the process in megabytes since the last call to resetPeakMemory. On Linux the peak can be
+// reset, so it belongs to the measured operation (together with the images that already existed before it).
+// Elsewhere it is the peak of the whole run so far.
+void resetPeakMemory()
+{
+#if defined(__linux__)
+	std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+double getPeakMemory()
+{
+#if defined(__linux__)
+	std::ifstream is("/proc/self/status");
+	std::string line;
+	while (std::getline(is, line))
+	{
+		if (line.compare(0, 6, "VmHWM:") == 0)
+		{
+			return std::atof(line.c_str() + 6) / 1024;
+		}
+	}
+#endif
+#if !defined(_WIN32)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+#else
+	return 0;
+#endif
+}
+
+// Runs an operation repeatedly and returns the fastest run. prepare is called before
+// every run and is not measured.
+Measurement measure(const std::string& operation, const FileFormat& format, unsigned width, unsigned height, size_t bytes,
+	const std::function<void()>& prepare, const std::function<void()>& run)
+{
+	double best = 0;
+	unsigned runs = 0;
+	resetPeakMemory();
+	// The time of prepare counts towards minimumSeconds too, so a fast operation on a large image is not
+	// repeated millions of times
+	const auto begin = std::chrono::steady_clock::now();
+	while (runs == 0 || std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < minimumSeconds)
+	{
+		prepare();
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (runs == 0 || seconds < best)
+		{
+			best = seconds;
+		}
+		runs++;
+	}
+	const double pixelCount = (double)width * height;
+	return Measurement{ format.name, width, height, operation, runs, best * 1e9 / pixelCount, bytes / best / 1e6, getPeakMemory() };
+}
+
+// Measures all operations on one generated image
+void measureImage(const FileFormat& format, unsigned width, unsigned height, std::vector<Measurement>& measurements)
+{
+	const std::string filePath = std::string("image_benchmark") + format.extension;
+	const std::string savedPath = std::string("image_benchmark_saved") + format.extension;
+	const size_t fileSize = generateFile(filePath, format, width, height);
+
+	Image loaded;
+	measurements.push_back(measure("loadImage", format, width, height, fileSize, [&]() { loaded = Image(); },
+		[&]() { loaded.loadImage(filePath); }));
+	// A raw image is only mapped by loadImage. The other operations are measured on an image whose pixels are
+	// already in memory, so they do not pay for reading the file.
+	Image source = loaded;
+	source.getData();
+	loaded = Image();
+	const size_t bytes = source.getStride() * source.getHeight();
+
+	measurements.push_back(measure("saveImage", format, width, height, fileSize, []() { },
+		[&]() { source.saveImage(savedPath); }));
+	std::remove(savedPath.c_str());
+
+	// Every operation works on its own copy of the image. The copy shares the pixels of the source until they are
+	// changed, so getData copies them before the measurement starts.
+	Image image;
+	const auto copy = [&]() { image = source; image.getData(); };
+	const std::pair<const char*, std::function<void()>> operations[] = {
+		{ "toGrayscale", [&]() { image.toGrayscale(); } },
+		{ "toMonochrome", [&]() { image.toMonochrome(); } },
+		{ "toNegative", [&]() { image.toNegative(); } },
+		{ "rotateLeft", [&]() { image.rotateLeft(); } },
+		{ "rotateRight", [&]() { image.rotateRight(); } },
+		{ "flipHorizontal", [&]() { image.flipHorizontal(); } },
+		{ "flipVertical", [&]() { image.flipVertical(); } },
+		// The middle quarter of the image. The y coordinates are counted from the bottom row.
+		{ "crop", [&]() { image.crop(width / 4, height * 3 / 4, width * 3 / 4, height / 4); } },
+	};
+	for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++)
+	{
+		measurements.push_back(measure(operations[i].first, format, width, height, bytes, copy, operations[i].second));
+	}
+	image = Image();
+	// A collage of the image with itself. The time per pixel is counted for the pixels of one input.
+	measurements.push_back(measure("makeCollage horizontal", format, width, height, bytes, [&]() { image = Image(); },
+		[&]() { image = makeCollage("horizontal", source, source); }));
+	measurements.push_back(measure("makeCollage vertical", format, width, height, bytes, [&]() { image = Image(); },
+		[&]() { image = makeCollage("vertical", source, source); }));
+	std::remove(filePath.c_str());
+}
+
+void writeJson(const std::string& filePath, const std::vector<Measurement>& measurements)
+{
+	std::ofstream os(filePath);
+	os << "{\n\t\"instructionSet\": \"" << getKernelLevelName(getKernelLevel()) << "\",\n\t\"threads\": "
+		<< getParallelWorkerCount() + 1 << ",\n\t\"results\": [\n";
+	for (size_t i = 0; i < measurements.size(); i++)
+	{
+		const Measurement& m = measurements[i];
+		os << std::setprecision(6) << "\t\t{ \"format\": \"" << m.format << "\", \"width\": " << m.width << ", \"height\": " << m.height
+			<< ", \"operation\": \"" << m.operation << "\", \"runs\": " << m.runs << ", \"nsPerPixel\": " << m.nsPerPixel
+			<< ", \"megabytesPerSecond\": " << m.megabytesPerSecond << ", \"peakMegabytes\": " << m.peakMegabytes << " }"
+			<< (i + 1 < measurements.size() ? ",\n" : "\n");
+	}
+	os << "\t]\n}\n";
+}
+
+// Returns the value of a field in a line of a JSON file written by writeJson, without the quotes
+std::string getField(const std::string& line, const std::string& name)
+{
+	const std::string key = "\"" + name + "\": ";
+	size_t start = line.find(key);
+	if (start == std::string::npos)
+	{
+		return "";
+	}
+	start += key.length();
+	if (line[start] == '"')
+	{
+		return line.substr(start + 1, line.find('"', start + 1) - start - 1);
+	}
+	return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+std::string getKey(const std::string& format, const std::string& width, const std::string& height, const std::string& operation)
+{
+	return format + " " + width + "x" + height + " " + operation;
+}
+
+// Compares the measurements with those of an earlier run and returns the number of regressions
+unsigned compare(const std::string& filePath, const std::vector<Measurement>& measurements)
+{
+	std::ifstream is(filePath);
+	if (!is)
+	{
+		std::cout << "Could not open file " << filePath << "\n";
+		return 0;
+	}
+	std::map<std::string, double> baseline;
+	std::string line;
+	while (std::getline(is, line))
+	{
+		const std::string operation = getField(line, "operation");
+		if (operation != "")
+		{
+			baseline[getKey(getField(line, "format"), getField(line, "width"), getField(line, "height"), operation)]
+				= std::atof(getField(line, "nsPerPixel").c_str());
+		}
+	}
+	unsigned regressions = 0;
+	std::cout << "\nCompared with " << filePath << " (time of this run / time of that run):\n";
+	for (size_t i = 0; i < measurements.size(); i++)
+	{
+		const Measurement& m = measurements[i];
+		const std::string key = getKey(m.format, std::to_string(m.width), std::to_string(m.height), m.operation);
+		const auto found = baseline.find(key);
+		if (found == baseline.end() || found->second <= 0)
+		{
+			continue;
+		}
+		const double ratio = m.nsPerPixel / found->second;
+		if (ratio > regressionRatio)
+		{
+			regressions++;
+		}
+		std::cout << std::left << std::setw(40) << key << std::right << std::fixed << std::setprecision(2) << std::setw(8) << ratio
+			<< (ratio > regressionRatio ? "  SLOWER" : "") << "\n";
+	}
+	std::cout << regressions << " measurements are more than " << (int)((regressionRatio - 1) * 100 + 0.5) << "% slower\n";
+	return regressions;
+}
+
+int main(int argc, char** argv)
+{
+	const double maxMegapixels = argc > 1 ? std::atof(argv[1]) : 100;
+	const std::string jsonPath = argc > 2 ? argv[2] : "image_benchmark.json";
+	std::cout << "Instruction set: " << getKernelLevelName(getKernelLevel()) << ", threads: " << getParallelWorkerCount() + 1 << "\n";
+	std::cout << std::left << std::setw(8) << "format" << std::setw(14) << "size" << std::setw(24) << "operation" << std::right
+		<< std::setw(10) << "ns/pixel" << std::setw(10) << "MB/s" << std::setw(10) << "peak MB" << "\n";
+
+	std::vector<Measurement> measurements;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		if ((double)sizes[s][0] * sizes[s][1] > maxMegapixels * 1e6)
+		{
+			continue;
+		}
+		for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+		{
+			const size_t first = measurements.size();
+			measureImage(formats[f], sizes[s][0], sizes[s][1], measurements);
+			for (size_t i = first; i < measurements.size(); i++)
+			{
+				const Measurement& m = measurements[i];
+				std::cout << std::left << std::setw(8) << m.format << std::setw(14) << (std::to_string(m.width) + "x" + std::to_string(m.height))
+					<< std::setw(24) << m.operation << std::right << std::fixed << std::setprecision(2) << std::setw(10) << m.nsPerPixel
+					<< std::setprecision(0) << std::setw(10) << m.megabytesPerSecond << std::setw(10) << m.peakMegabytes << "\n";
+			}
+		}
+	}
+	writeJson(jsonPath, measurements);
+	std::cout << "The results are in " << jsonPath << "\n";
+	if (argc > 3)
+	{
+		return compare(argv[3], measurements) == 0 ? 0 : 1;
+	}
+	return 0;
+}
@@ -0,0 +1,192 @@
+#include "Kernels.h"
+#include "Cpu.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+/* A small standalone program that measures the throughput of the vectorised point operations at every
+instruction set level supported by the processor, for 8-bit and 16-bit values. Before measuring, it runs every
+version on random images of several sizes (odd sizes, so the remainder after the last full vector is always
+handled too) and checks that the results are exactly the same as those of the plain C++ version. It is built
+from this file together with Kernels/Kernels.cpp, Cpu/Cpu.cpp and PointOps/PointOps.cpp, for example:
+	g++ -O2 -ICpu -IKernels -IPointOps Benchmark/KernelsBenchmark.cpp Kernels/Kernels.cpp Cpu/Cpu.cpp PointOps/PointOps.cpp
+The optional argument is the size of the measured image in megapixels (12 by default). */
+
+enum KernelName
+{
+	grayKernel,
+	averageKernel,
+	grayToRGBKernel,
+	negateKernel,
+	thresholdKernel,
+	byteOrderKernel, // Only for 16-bit values
+};
+
+const char* kernelNames[] = { "rgb to gray", "rgb to average", "gray to rgb", "negate", "threshold", "byte order" };
+
+// The last kernel that exists for the type of the values
+template <typename Sample>
+KernelName getLastKernel()
+{
+	return sizeof(Sample) == 2 ? byteOrderKernel : thresholdKernel;
+}
+
+// Runs one kernel on an RGB image of pixelCount pixels, writing the result into result, which must be as large as
+// the image. The gray expansion uses the first pixelCount values of the image as its gray values.
+template <typename Sample>
+void run(KernelName kernel, const std::vector<Sample>& rgb, std::vector<Sample>& result, size_t pixelCount, unsigned short maxValue)
+{
+	switch (kernel)
+	{
+	case grayKernel:
+		rgbToGray(rgb.data(), result.data(), pixelCount);
+		break;
+	case averageKernel:
+		rgbToAverage(rgb.data(), result.data(), pixelCount);
+		break;
+	case grayToRGBKernel:
+		grayToRGB(rgb.data(), result.data(), pixelCount);
+		break;
+	case negateKernel:
+		result = rgb;
+		negate(result.data(), result.size(), maxValue);
+		break;
+	case thresholdKernel:
+		result = rgb;
+		threshold(result.data(), result.size(), maxValue);
+		break;
+	case byteOrderKernel:
+		result = rgb;
+		convertBigEndian((unsigned short*)result.data(), result.size());
+		break;
+	}
+}
+
+template <typename Sample>
+std::vector<Sample> randomImage(std::mt19937& random, size_t pixelCount, unsigned short maxValue)
+{
+	std::vector<Sample> rgb(pixelCount * 3);
+	for (size_t i = 0; i < rgb.size(); i++)
+	{
+		rgb[i] = (Sample)(random() % (maxValue + 1u));
+	}
+	return rgb;
+}
+
+// Compares every level with the scalar one, which runs the plain C++ version of every kernel. Returns the number
+// of mismatches.
+template <typename Sample>
+unsigned verify()
+{
+	std::mt19937 random(2024);
+	const KernelLevel detected = detectKernelLevel();
+	// The maximum values of the type: 1 to 255 for 8-bit values and 256 to 65535 for 16-bit ones
+	const unsigned minMaxValue = sizeof(Sample) == 2 ? 256 : 1;
+	const unsigned maxMaxValue = sizeof(Sample) == 2 ? 65535 : 255;
+	unsigned mismatches = 0;
+	for (int attempt = 0; attempt < 200; attempt++)
+	{
+		const size_t pixelCount = (random() % 1000 + (attempt % 4 == 0 ? 100000 : 0)) | 1;
+		const unsigned short maxValue = (unsigned short)(attempt % 3 == 0 ? maxMaxValue : random() % (maxMaxValue - minMaxValue + 1) + minMaxValue);
+		const std::vector<Sample> rgb = randomImage<Sample>(random, pixelCount, maxValue);
+		std::vector<Sample> expected(rgb.size()), result(rgb.size());
+		for (int kernel = grayKernel; kernel <= getLastKernel<Sample>(); kernel++)
+		{
+			setKernelLevel(scalarLevel);
+			run((KernelName)kernel, rgb, expected, pixelCount, maxValue);
+			for (int level = sse2Level; level <= detected; level++)
+			{
+				setKernelLevel((KernelLevel)level);
+				std::fill(result.begin(), result.end(), (Sample)0);
+				run((KernelName)kernel, rgb, result, pixelCount, maxValue);
+				if (result != expected)
+				{
+					std::cout << "MISMATCH: " << sizeof(Sample) * 8 << "-bit " << kernelNames[kernel] << " at "
+						<< getKernelLevelName((KernelLevel)level) << ", " << pixelCount << " pixels, maximum value " << maxValue << "\n";
+					mismatches++;
+				}
+			}
+		}
+	}
+	setKernelLevel(detected);
+	return mismatches;
+}
+
+// Prints the throughput of every kernel at every level, in megabytes of the RGB image per second
+template <typename Sample>
+void measure(size_t pixelCount, unsigned short maxValue)
+{
+	const KernelLevel detected = detectKernelLevel();
+	std::mt19937 random(7);
+	const std::vector<Sample> rgb = randomImage<Sample>(random, pixelCount, maxValue);
+	std::vector<Sample> buffer(rgb.size());
+	const double megabytes = rgb.size() * sizeof(Sample) / 1e6;
+
+	std::cout << std::setw(10) << sizeof(Sample) * 8 << "-bit MB/s";
+	for (int level = scalarLevel; level <= detected; level++)
+	{
+		std::cout << std::setw(10) << getKernelLevelName((KernelLevel)level);
+	}
+	std::cout << "\n";
+	for (int kernel = grayKernel; kernel <= getLastKernel<Sample>(); kernel++)
+	{
+		std::cout << std::setw(16) << kernelNames[kernel];
+		for (int level = scalarLevel; level <= detected; level++)
+		{
+			setKernelLevel((KernelLevel)level);
+			double best = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				buffer = rgb;
+				const auto start = std::chrono::steady_clock::now();
+				switch (kernel)
+				{
+				case grayKernel:
+					rgbToGray(rgb.data(), buffer.data(), pixelCount);
+					break;
+				case averageKernel:
+					rgbToAverage(rgb.data(), buffer.data(), pixelCount);
+					break;
+				case grayToRGBKernel:
+					grayToRGB(rgb.data(), buffer.data(), pixelCount);
+					break;
+				case negateKernel:
+					negate(buffer.data(), buffer.size(), maxValue);
+					break;
+				case thresholdKernel:
+					threshold(buffer.data(), buffer.size(), maxValue);
+					break;
+				case byteOrderKernel:
+					convertBigEndian((unsigned short*)buffer.data(), buffer.size());
+					break;
+				}
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (megabytes / seconds > best)
+				{
+					best = megabytes / seconds;
+				}
+			}
+			std::cout << std::fixed << std::setprecision(0) << std::setw(10) << best;
+		}
+		std::cout << "\n";
+	}
+	setKernelLevel(detected);
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned megapixels = argc > 1 ? std::atoi(argv[1]) : 12;
+	std::cout << "Detected instruction set: " << getKernelLevelName(detectKernelLevel()) << "\n";
+
+	const unsigned mismatches = verify<unsigned char>() + verify<unsigned short>();
+	std::cout << (mismatches == 0 ? "All levels are bit-exact with the scalar kernels\n" : "Some levels differ from the scalar kernels\n");
+
+	const size_t pixelCount = (size_t)megapixels * 1000000;
+	measure<unsigned char>(pixelCount, 255);
+	measure<unsigned short>(pixelCount, 65535);
+	return mismatches == 0 ? 0 : 1;
+}
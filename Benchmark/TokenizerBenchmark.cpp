@@ -0,0 +1,96 @@
+#include "Tokenizer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+/* A small standalone program that measures how fast the values of a plain .ppm file are parsed. It writes
+a file with random samples, first with a comment and irregular wrapping (several spaces, tabs, '\r' and
+empty lines) to check that every value comes back unchanged, and then in the usual style of one space
+between values and lines of at most 70 characters to measure the throughput. It is built from this file
+together with Tokenizer/Tokenizer.cpp, for example:
+	g++ -O2 -ITokenizer Benchmark/TokenizerBenchmark.cpp Tokenizer/Tokenizer.cpp
+The optional argument is the size of the measured image in megapixels (6 by default). */
+
+const char* filePath = "tokenizer_benchmark.ppm";
+
+// Writes the samples as the data of a plain .ppm file and returns the size of the file in bytes
+size_t writeFile(const std::vector<unsigned char>& samples, bool irregular, std::mt19937& random)
+{
+	std::ofstream os(filePath, std::ios::binary);
+	os << "P3\n# random samples\n" << samples.size() / 3 << " 1\n255\n";
+	const char* separators[] = { " ", "  ", "\t", "\r\n", "\n\n", " \n", "\n# a comment 1 2 3\n" };
+	size_t lineLength = 0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		const std::string value = std::to_string(samples[i]);
+		if (irregular)
+		{
+			os << value << separators[random() % 7];
+		}
+		else if (lineLength + value.size() + 1 > 70)
+		{
+			os << "\n" << value;
+			lineLength = value.size();
+		}
+		else
+		{
+			os << (i == 0 ? "" : " ") << value;
+			lineLength += value.size() + 1;
+		}
+	}
+	os << "\n";
+	return (size_t)os.tellp();
+}
+
+// Reads the file back in the same way as Image does for plain .ppm files
+bool readFile(std::vector<unsigned char>& samples)
+{
+	Tokenizer is;
+	unsigned width, height, maxValue;
+	return is.open(filePath) && is.get() == 'P' && is.get() == '3' && is.readNumber(width) && is.readNumber(height)
+		&& is.readNumber(maxValue) && is.readNumbers(samples.data(), samples.size(), 1);
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned megapixels = argc > 1 ? std::atoi(argv[1]) : 6;
+	std::mt19937 random(2024);
+
+	std::vector<unsigned char> samples(300000);
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		samples[i] = (unsigned char)random();
+	}
+	writeFile(samples, true, random);
+	std::vector<unsigned char> result(samples.size());
+	const bool correct = readFile(result) && result == samples;
+	std::cout << (correct ? "Irregularly wrapped values are read correctly\n" : "Irregularly wrapped values are NOT read correctly\n");
+
+	samples.resize((size_t)megapixels * 3000000);
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		samples[i] = (unsigned char)random();
+	}
+	const size_t fileSize = writeFile(samples, false, random);
+	result.assign(samples.size(), 0);
+	double best = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		readFile(result);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (fileSize / seconds / 1e6 > best)
+		{
+			best = fileSize / seconds / 1e6;
+		}
+	}
+	std::remove(filePath);
+	std::cout << "Plain .ppm parsing: " << std::fixed << std::setprecision(0) << best << " MB/s (" << fileSize / 1000000 << " MB file)\n";
+	return correct && result == samples ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include "Transpose.h"
+#include "Cpu.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+/* A small standalone program that measures the throughput of the transpose engine, which is used
+by the rotations, against the naive column walk. It is built from this file together with
+Transpose/Transpose.cpp and Cpu/Cpu.cpp, for example:
+	g++ -O2 -ICpu -ITranspose Benchmark/TransposeBenchmark.cpp Transpose/Transpose.cpp Cpu/Cpu.cpp
+The optional argument is the largest image size in megapixels (100 by default). */
+
+typedef void (*TransposeFunction)(const unsigned char*, ptrdiff_t, unsigned char*, ptrdiff_t, size_t, size_t, size_t);
+
+// Returns the throughput in MB/s of the image data (the size of one image per run).
+double measure(TransposeFunction function, const std::vector<unsigned char>& src, std::vector<unsigned char>& dst,
+	size_t width, size_t height, size_t pixelSize)
+{
+	// Small images are transposed several times and the fastest run is taken.
+	const int runs = width * height <= 4000000 ? 5 : 2;
+	double best = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		// Rotation to the left: the destination is walked from its last row upwards
+		const ptrdiff_t dstStride = (ptrdiff_t)(height * pixelSize);
+		function(src.data(), width * pixelSize, dst.data() + (width - 1) * dstStride, -dstStride, width, height, pixelSize);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double speed = src.size() / seconds / 1e6;
+		if (speed > best)
+		{
+			best = speed;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned maxMegapixels = argc > 1 ? std::atoi(argv[1]) : 100;
+	const unsigned megapixels[] = { 1, 4, 16, 36, 64, 100 };
+	const KernelLevel detected = detectKernelLevel();
+
+	std::cout << "Detected instruction set: " << getKernelLevelName(detected) << "\n";
+	std::cout << std::setw(6) << "MP" << std::setw(8) << "bytes" << std::setw(12) << "naive";
+	for (int level = scalarLevel; level <= detected; level++)
+	{
+		std::cout << std::setw(12) << getKernelLevelName((KernelLevel)level);
+	}
+	std::cout << "   (MB/s)\n";
+
+	for (unsigned mp : megapixels)
+	{
+		if (mp > maxMegapixels)
+		{
+			break;
+		}
+		// A 4:3 image with the requested number of pixels
+		const size_t height = (size_t)(std::sqrt(mp * 1e6 * 3 / 4));
+		const size_t width = mp * 1000000 / height;
+		for (size_t pixelSize : { 1, 3 })
+		{
+			std::vector<unsigned char> src(width * height * pixelSize), dst(src.size());
+			for (size_t i = 0; i < src.size(); i++)
+			{
+				src[i] = (unsigned char)(i * 2654435761u >> 24);
+			}
+
+			std::cout << std::fixed << std::setprecision(0) << std::setw(6) << mp << std::setw(8) << pixelSize
+				<< std::setw(12) << measure(transposeNaive, src, dst, width, height, pixelSize);
+			for (int level = scalarLevel; level <= detected; level++)
+			{
+				setKernelLevel((KernelLevel)level);
+				std::cout << std::setw(12) << measure(transpose, src, dst, width, height, pixelSize);
+			}
+			setKernelLevel(detected);
+			std::cout << "\n";
+		}
+	}
+	return 0;
+}
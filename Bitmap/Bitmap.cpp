@@ -0,0 +1,230 @@
+#include "Bitmap.h"
+#include <cstdint>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+namespace
+{
+	// The first byte of a row holds its first bits, so 64-bit words are loaded and stored as big-endian numbers,
+	// where the first bit of the word is its most significant bit.
+	inline uint64_t swapBytes(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		return _byteswap_uint64(value);
+#else
+		return __builtin_bswap64(value);
+#endif
+	}
+
+	inline uint64_t loadWord(const unsigned char* p)
+	{
+		uint64_t value;
+		std::memcpy(&value, p, 8);
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		value = swapBytes(value);
+#endif
+		return value;
+	}
+
+	inline void storeWord(unsigned char* p, uint64_t value)
+	{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		value = swapBytes(value);
+#endif
+		std::memcpy(p, &value, 8);
+	}
+
+	// Reads the 64 bits that start at the given bit. Byte p[8] is read only when the bits reach into it.
+	inline uint64_t readWord(const unsigned char* src, size_t bit)
+	{
+		const unsigned char* p = src + bit / 8;
+		const unsigned shift = bit % 8;
+		const uint64_t value = loadWord(p);
+		return shift == 0 ? value : (value << shift) | (p[8] >> (8 - shift));
+	}
+
+	// Reads the 8 bits that start at the given bit. Byte p[1] is read only when the bits reach into it.
+	inline unsigned char readByte(const unsigned char* src, size_t bit)
+	{
+		const unsigned char* p = src + bit / 8;
+		const unsigned shift = bit % 8;
+		return shift == 0 ? p[0] : (unsigned char)((p[0] << shift) | (p[1] >> (8 - shift)));
+	}
+
+	inline void setBit(unsigned char* row, size_t bit, unsigned char value)
+	{
+		const unsigned char mask = (unsigned char)(0x80 >> (bit % 8));
+		row[bit / 8] = value != 0 ? row[bit / 8] | mask : row[bit / 8] & ~mask;
+	}
+
+	// Reverses the order of the bits in every byte of a word: neighbouring bits, pairs and nibbles are swapped
+	inline uint64_t reverseBitsInBytes(uint64_t value)
+	{
+		value = ((value >> 1) & 0x5555555555555555ull) | ((value & 0x5555555555555555ull) << 1);
+		value = ((value >> 2) & 0x3333333333333333ull) | ((value & 0x3333333333333333ull) << 2);
+		return ((value >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((value & 0x0F0F0F0F0F0F0F0Full) << 4);
+	}
+
+	// Transposes a matrix of 8 x 8 bits, whose first row is the most significant byte and whose first column
+	// is the most significant bit of every byte. Blocks of 1 x 1, 2 x 2 and 4 x 4 bits are swapped across the
+	// diagonal (Hacker's Delight, 7-3).
+	inline uint64_t transpose8x8(uint64_t x)
+	{
+		uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+		x = x ^ t ^ (t << 7);
+		t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+		x = x ^ t ^ (t << 14);
+		t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+		return x ^ t ^ (t << 28);
+	}
+}
+
+void packBits(const unsigned char* src, size_t step, unsigned char* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8, src += 8 * step)
+	{
+		unsigned char bits = 0;
+		for (size_t j = 0; j < 8; j++)
+		{
+			bits = (unsigned char)((bits << 1) | (src[j * step] != 0));
+		}
+		*dst++ = bits;
+	}
+	if (i < count)
+	{
+		unsigned char bits = 0;
+		for (size_t j = 0; i + j < count; j++)
+		{
+			bits |= (unsigned char)((src[j * step] != 0) << (7 - j));
+		}
+		*dst = bits;
+	}
+}
+
+void unpackBits(const unsigned char* src, unsigned char* dst, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		dst[i] = getBit(src, i);
+	}
+}
+
+void copyBits(const unsigned char* src, size_t srcBit, unsigned char* dst, size_t dstBit, size_t count)
+{
+	// The bits before the first whole byte of dst are copied one by one
+	for (; count > 0 && dstBit % 8 != 0; count--)
+	{
+		setBit(dst, dstBit++, getBit(src, srcBit++));
+	}
+	unsigned char* p = dst + dstBit / 8;
+	for (; count >= 64; count -= 64, srcBit += 64, p += 8)
+	{
+		storeWord(p, readWord(src, srcBit));
+	}
+	for (; count >= 8; count -= 8, srcBit += 8)
+	{
+		*p++ = readByte(src, srcBit);
+	}
+	if (count > 0)
+	{
+		// Only the first count bits of the last byte change
+		const unsigned char mask = (unsigned char)(0xFF00 >> count);
+		unsigned char bits = 0;
+		for (size_t j = 0; j < count; j++)
+		{
+			bits |= (unsigned char)(getBit(src, srcBit + j) << (7 - j));
+		}
+		*p = (unsigned char)((*p & ~mask) | bits);
+	}
+}
+
+void fillBits(unsigned char* dst, size_t dstBit, size_t count, bool value)
+{
+	for (; count > 0 && dstBit % 8 != 0; count--)
+	{
+		setBit(dst, dstBit++, value);
+	}
+	unsigned char* p = dst + dstBit / 8;
+	std::memset(p, value ? 0xFF : 0, count / 8);
+	p += count / 8;
+	if (count % 8 != 0)
+	{
+		const unsigned char mask = (unsigned char)(0xFF00 >> (count % 8));
+		*p = value ? *p | mask : *p & ~mask;
+	}
+}
+
+void invertBits(unsigned char* row, size_t count)
+{
+	const size_t wholeBytes = count / 8;
+	size_t i = 0;
+	for (; i + 8 <= wholeBytes; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, row + i, 8);
+		word = ~word;
+		std::memcpy(row + i, &word, 8);
+	}
+	for (; i < wholeBytes; i++)
+	{
+		row[i] = (unsigned char)~row[i];
+	}
+	if (count % 8 != 0)
+	{
+		row[i] ^= (unsigned char)(0xFF00 >> (count % 8));
+	}
+}
+
+// The bytes are reversed together with the bits in them, eight bytes at a time. The last byte of the row
+// can have unused bits, which then come first, so the result is shifted to the left by their number.
+void reverseBits(const unsigned char* src, unsigned char* dst, size_t count)
+{
+	const size_t size = getBitRowSize(count);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		const uint64_t word = loadWord(src + i);
+		storeWord(dst + size - 8 - i, swapBytes(reverseBitsInBytes(word)));
+	}
+	for (; i < size; i++)
+	{
+		dst[size - 1 - i] = (unsigned char)(reverseBitsInBytes(src[i]) & 0xFF);
+	}
+	const size_t unused = size * 8 - count;
+	if (unused != 0)
+	{
+		copyBits(dst, unused, dst, 0, count);
+		dst[size - 1] &= (unsigned char)(0xFF00 >> (8 - unused));
+	}
+}
+
+// The source is processed in blocks of 8 rows and one byte (8 columns). The block is gathered into one word,
+// transposed and scattered into 8 rows of the destination, each of which gets one byte of it. Missing rows
+// at the bottom of the source count as zeros, so the unused bits of the destination rows stay zeros.
+void transposeBits(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride, size_t width, size_t height)
+{
+	const size_t columnBytes = getBitRowSize(width);
+	for (size_t top = 0; top < height; top += 8)
+	{
+		const size_t rows = height - top < 8 ? height - top : 8;
+		const unsigned char* block = src + (ptrdiff_t)top * srcStride;
+		for (size_t column = 0; column < columnBytes; column++)
+		{
+			uint64_t word = 0;
+			for (size_t j = 0; j < rows; j++)
+			{
+				word |= (uint64_t)block[(ptrdiff_t)j * srcStride + column] << (56 - 8 * j);
+			}
+			word = transpose8x8(word);
+			const size_t columns = width - column * 8 < 8 ? width - column * 8 : 8;
+			unsigned char* target = dst + (ptrdiff_t)(column * 8) * dstStride + top / 8;
+			for (size_t j = 0; j < columns; j++)
+			{
+				target[(ptrdiff_t)j * dstStride] = (unsigned char)(word >> (56 - 8 * j));
+			}
+		}
+	}
+}
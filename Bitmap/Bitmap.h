@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+
+/* The pixels of .pbm images are stored as bits, eight in a byte, starting from the most significant bit -
+exactly like the rows of a raw .pbm file. Every row starts at a new byte, and the bits after its last pixel
+are zeros. The functions here work on such rows one 64-bit word at a time wherever possible: a negative
+is an XOR, a flip reverses the order of the bits, and a rotation transposes blocks of 8 x 8 bits. Bits are
+numbered from the start of the row, so bit i is in byte i / 8. */
+
+// The number of bytes in a row of count bits
+inline size_t getBitRowSize(size_t count)
+{
+	return (count + 7) / 8;
+}
+
+inline unsigned char getBit(const unsigned char* row, size_t bit)
+{
+	return (row[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+// Packs count values (every step-th byte of src, zero or not) into bits. The bits after them in the last byte become 0.
+void packBits(const unsigned char* src, size_t step, unsigned char* dst, size_t count);
+// Unpacks count bits into bytes with the value 0 or 1
+void unpackBits(const unsigned char* src, unsigned char* dst, size_t count);
+
+// Copies count bits, starting at srcBit of src, to the bits starting at dstBit of dst. The other bits of dst do
+// not change. The areas may overlap only if dst starts before src, like when a row is shifted to the left.
+void copyBits(const unsigned char* src, size_t srcBit, unsigned char* dst, size_t dstBit, size_t count);
+// Sets count bits, starting at dstBit, to value
+void fillBits(unsigned char* dst, size_t dstBit, size_t count, bool value);
+// Inverts the first count bits of a row (the negative). The bits after them do not change.
+void invertBits(unsigned char* row, size_t count);
+// Writes the first count bits of src to dst in reverse order (a horizontal flip). src and dst must not overlap.
+void reverseBits(const unsigned char* src, unsigned char* dst, size_t count);
+
+// Transposes the bits of height rows of width bits: bit x of row y becomes bit y of row x of dst. Just like with
+// transpose in Transpose.h, the strides can be negative, which reverses the order of the rows.
+void transposeBits(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride, size_t width, size_t height);
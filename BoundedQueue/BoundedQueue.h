@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/* A queue of at most capacity items that is shared by the threads of two stages of a pipeline (see Batch).
+The producers wait while it is full, so a fast stage cannot run ahead of a slow one by more than the capacity,
+and the consumers wait while it is empty. When every producer has finished, the queue is closed: the consumers
+take the items that are left and then stop. */
+
+template <typename T>
+class BoundedQueue
+{
+private:
+	std::deque<T> items;
+	size_t capacity;
+	bool closed;
+	std::mutex mutex;
+	std::condition_variable itemAdded;   // Wakes up a consumer when an item is added or the queue is closed
+	std::condition_variable itemRemoved; // Wakes up a producer when there is room again
+
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) { }
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Adds an item, waiting while the queue is full
+	void push(T&& item)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->itemRemoved.wait(lock, [this] { return this->items.size() < this->capacity; });
+		this->items.push_back(std::move(item));
+		lock.unlock();
+		this->itemAdded.notify_one();
+	}
+
+	// Takes the oldest item, waiting while the queue is empty. Returns false when the queue is closed and empty.
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->itemAdded.wait(lock, [this] { return !this->items.empty() || this->closed; });
+		if (this->items.empty())
+		{
+			return false;
+		}
+		item = std::move(this->items.front());
+		this->items.pop_front();
+		lock.unlock();
+		this->itemRemoved.notify_one();
+		return true;
+	}
+
+	// Tells the consumers that no more items will be added
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->closed = true;
+		}
+		this->itemAdded.notify_all();
+	}
+};
@@ -0,0 +1,101 @@
+#include "Cpu.h"
+#include <atomic>
+
+#if defined(NETPBM_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+KernelLevel detectKernelLevel()
+{
+#if defined(NETPBM_X86) && defined(_MSC_VER)
+	// Leaf 1 contains the SSE flags and leaf 7 the AVX2 and AVX-512 flags. The wide registers
+	// can be used only if the operating system saves them, which is reported by XGETBV.
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool ssse3 = (info[2] & (1 << 9)) != 0;
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool avx2 = false, avx512 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+		avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xe6) == 0xe6;
+	}
+#elif defined(NETPBM_X86)
+	// GCC and Clang check both the processor and the operating system support.
+	__builtin_cpu_init();
+	const bool sse2 = __builtin_cpu_supports("sse2");
+	const bool ssse3 = __builtin_cpu_supports("ssse3");
+	const bool sse41 = __builtin_cpu_supports("sse4.1");
+	const bool avx2 = __builtin_cpu_supports("avx2");
+	const bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#else
+	const bool sse2 = false, ssse3 = false, sse41 = false, avx2 = false, avx512 = false;
+#endif
+	if (avx512 && avx2)
+	{
+		return avx512Level;
+	}
+	if (avx2 && sse41)
+	{
+		return avx2Level;
+	}
+	if (sse41 && ssse3)
+	{
+		return sse41Level;
+	}
+	if (ssse3)
+	{
+		return ssse3Level;
+	}
+	if (sse2)
+	{
+		return sse2Level;
+	}
+	return scalarLevel;
+}
+
+// The detection is done only once, the first time a kernel asks for the level.
+static std::atomic<int> currentLevel(-1);
+
+KernelLevel getKernelLevel()
+{
+	int level = currentLevel.load(std::memory_order_relaxed);
+	if (level < 0)
+	{
+		level = detectKernelLevel();
+		currentLevel.store(level, std::memory_order_relaxed);
+	}
+	return (KernelLevel)level;
+}
+
+void setKernelLevel(KernelLevel level)
+{
+	const KernelLevel detected = detectKernelLevel();
+	currentLevel.store(level <= detected ? level : detected, std::memory_order_relaxed);
+}
+
+const char* getKernelLevelName(KernelLevel level)
+{
+	switch (level)
+	{
+	case sse2Level:
+		return "SSE2";
+	case ssse3Level:
+		return "SSSE3";
+	case sse41Level:
+		return "SSE4.1";
+	case avx2Level:
+		return "AVX2";
+	case avx512Level:
+		return "AVX-512";
+	default:
+		return "scalar";
+	}
+}
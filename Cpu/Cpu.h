@@ -0,0 +1,41 @@
+#pragma once
+
+/* Some of the kernels that process the pixels have several versions - a plain C++ one that works
+everywhere and vectorised ones that use the SIMD instructions of newer processors. Which version is
+used is decided once, at runtime, based on what the processor (and the operating system) supports. */
+
+// The instruction set extensions that the kernels can use. The levels are ordered,
+// so every level includes all of the levels before it.
+enum KernelLevel
+{
+	scalarLevel,  // Plain C++
+	sse2Level,    // SSE2 (always available on x86-64)
+	ssse3Level,   // SSSE3 - adds byte shuffles
+	sse41Level,   // SSE4.1
+	avx2Level,    // AVX2 - 256-bit integer operations
+	avx512Level,  // AVX-512 F and BW - 512-bit integer operations
+};
+
+KernelLevel detectKernelLevel();		 // Returns the best level supported by the processor
+KernelLevel getKernelLevel();			 // Returns the level currently used by the kernels
+void setKernelLevel(KernelLevel level);	 // Changes the level used by the kernels. Levels above the detected one are ignored.
+const char* getKernelLevelName(KernelLevel level);
+
+// The vectorised kernels are written with intrinsics, which exist only on x86 processors.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NETPBM_X86
+#endif
+
+// MSVC allows intrinsics of any instruction set in every function, while GCC and Clang
+// need to be told which functions may use them.
+#if defined(NETPBM_X86) && !defined(_MSC_VER)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define TARGET_SSSE3
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
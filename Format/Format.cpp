@@ -0,0 +1,205 @@
+#include "Format.h"
+#include "Bitmap.h"
+#include "Kernels.h"
+#include "Transpose.h"
+#include <cstring>
+
+FormatTag getFormatTag(ImageFormat format, size_t sampleSize, size_t channels)
+{
+	if (format == pbmFormat)
+	{
+		return pbmBitsTag;
+	}
+	if (format == pgmFormat)
+	{
+		return sampleSize == 2 ? pgm16Tag : pgm8Tag;
+	}
+	if (channels == 1)
+	{
+		return sampleSize == 2 ? ppmGray16Tag : ppmGray8Tag;
+	}
+	return sampleSize == 2 ? ppmRGB16Tag : ppmRGB8Tag;
+}
+
+// The kernels for pixels of Channels values of the type Sample. Everything that depends on the format is a
+// constant here, so every branch on it disappears when the template is compiled.
+template <ImageFormat Format, typename Sample, size_t Channels>
+struct PixelKernels
+{
+	static const size_t pixelSize = Channels * sizeof(Sample);
+	// Gray .ppm images are written with three values per pixel
+	static const size_t rawChannels = Format == ppmFormat ? 3 : 1;
+	static const size_t rawPixelSize = rawChannels * sizeof(Sample);
+	static const bool rawLayout = sizeof(Sample) == 1 && Channels == rawChannels;
+
+	static void applyPointOps(const PointOpsPass& pass, const unsigned char* src, unsigned char* dst, size_t rowCount,
+		size_t width, unsigned short maxValue)
+	{
+		applyPointOpsPass(pass, (const Sample*)src, (Sample*)dst, rowCount, width, maxValue, Channels);
+	}
+
+	// The pixels are swapped from both ends until the end of the first row is reached or, when both rows are the
+	// same, until they meet in the middle. Swapping a pixel is a few moves of a known size instead of a loop.
+	static void swapReversedRows(unsigned char* first, unsigned char* second, size_t width, unsigned char*)
+	{
+		unsigned char* last = second + (width - 1) * pixelSize;
+		const unsigned char* end = first + width * pixelSize;
+		for (; first < end && first < last; first += pixelSize, last -= pixelSize)
+		{
+			unsigned char pixel[pixelSize];
+			std::memcpy(pixel, first, pixelSize);
+			std::memcpy(first, last, pixelSize);
+			std::memcpy(last, pixel, pixelSize);
+		}
+	}
+
+	static void reverseRow(const unsigned char* src, unsigned char* dst, size_t width)
+	{
+		dst += (width - 1) * pixelSize;
+		for (size_t i = 0; i < width; i++, src += pixelSize, dst -= pixelSize)
+		{
+			std::memcpy(dst, src, pixelSize);
+		}
+	}
+
+	static void copyPixels(const unsigned char* src, size_t srcColumn, unsigned char* dst, size_t dstColumn, size_t count)
+	{
+		std::memmove(dst + dstColumn * pixelSize, src + srcColumn * pixelSize, count * pixelSize);
+	}
+
+	// Black is 0 in both .pgm and .ppm
+	static void fillBlack(unsigned char* dst, size_t dstColumn, size_t count)
+	{
+		std::memset(dst + dstColumn * pixelSize, 0, count * pixelSize);
+	}
+
+	static void transposeColumns(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+		size_t firstColumn, size_t columnCount, size_t height)
+	{
+		transpose(src + firstColumn * pixelSize, srcStride, dst + (ptrdiff_t)firstColumn * dstStride, dstStride, columnCount, height, pixelSize);
+	}
+
+	static void writePlainRow(Writer& os, const unsigned char* row, size_t width, unsigned char* scratch)
+	{
+		const Sample* values = (const Sample*)row;
+		if constexpr (Channels != rawChannels)
+		{
+			grayToRGB(values, (Sample*)scratch, width);
+			values = (const Sample*)scratch;
+		}
+		os.writeNumbers(values, width * rawChannels, 1);
+	}
+
+	// 16-bit values are stored with the most significant byte first
+	static void packRawRow(const unsigned char* row, unsigned char* dst, size_t width)
+	{
+		if constexpr (Channels != rawChannels)
+		{
+			grayToRGB((const Sample*)row, (Sample*)dst, width);
+		}
+		else
+		{
+			std::memcpy(dst, row, width * pixelSize);
+		}
+		if constexpr (sizeof(Sample) == 2)
+		{
+			convertBigEndian((unsigned short*)dst, width * rawChannels);
+		}
+	}
+};
+
+// The pixels of .pbm images are bits, which are processed with the functions from Bitmap.h
+template <>
+struct PixelKernels<pbmFormat, unsigned char, 1>
+{
+	static const size_t pixelSize = 0;
+	static const size_t rawPixelSize = 0;
+	static const bool rawLayout = true; // The rows of raw .pbm files are stored exactly like this
+
+	// A bit can only stay the same, be inverted or always become 0 or 1
+	static void applyPointOps(const PointOpsPass& pass, const unsigned char* src, unsigned char* dst, size_t rowCount,
+		size_t width, unsigned short)
+	{
+		const size_t stride = getBitRowSize(width);
+		if (dst != src)
+		{
+			std::memcpy(dst, src, rowCount * stride);
+		}
+		for (size_t i = 0; i < rowCount; i++, dst += stride)
+		{
+			if (pass.lutBefore[0] == pass.lutBefore[1])
+			{
+				fillBits(dst, 0, width, pass.lutBefore[0] != 0);
+			}
+			else if (pass.lutBefore[0] != 0)
+			{
+				invertBits(dst, width);
+			}
+		}
+	}
+
+	// The bits of the rows are reversed into the scratch buffer and copied back into the other row
+	static void swapReversedRows(unsigned char* first, unsigned char* second, size_t width, unsigned char* scratch)
+	{
+		const size_t stride = getBitRowSize(width);
+		reverseBits(first, scratch, width);
+		if (second != first)
+		{
+			reverseBits(second, scratch + stride, width);
+			std::memcpy(first, scratch + stride, stride);
+		}
+		std::memcpy(second, scratch, stride);
+	}
+
+	static void reverseRow(const unsigned char* src, unsigned char* dst, size_t width)
+	{
+		reverseBits(src, dst, width);
+	}
+
+	static void copyPixels(const unsigned char* src, size_t srcColumn, unsigned char* dst, size_t dstColumn, size_t count)
+	{
+		copyBits(src, srcColumn, dst, dstColumn, count);
+	}
+
+	// In .pbm the value 1 is black
+	static void fillBlack(unsigned char* dst, size_t dstColumn, size_t count)
+	{
+		fillBits(dst, dstColumn, count, true);
+	}
+
+	static void transposeColumns(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+		size_t firstColumn, size_t columnCount, size_t height)
+	{
+		transposeBits(src + firstColumn / 8, srcStride, dst + (ptrdiff_t)firstColumn * dstStride, dstStride, columnCount, height);
+	}
+
+	static void writePlainRow(Writer& os, const unsigned char* row, size_t width, unsigned char*)
+	{
+		os.writeBits(row, width);
+	}
+
+	static void packRawRow(const unsigned char* row, unsigned char* dst, size_t width)
+	{
+		std::memcpy(dst, row, getBitRowSize(width));
+	}
+};
+
+template <ImageFormat Format, typename Sample, size_t Channels>
+constexpr FormatKernels makeFormatKernels()
+{
+	typedef PixelKernels<Format, Sample, Channels> Functions;
+	return FormatKernels{ Format, sizeof(Sample), Channels, Functions::pixelSize, Functions::rawPixelSize, Functions::rawLayout,
+		&Functions::applyPointOps, &Functions::swapReversedRows, &Functions::reverseRow, &Functions::copyPixels, &Functions::fillBlack,
+		&Functions::transposeColumns, &Functions::writePlainRow, &Functions::packRawRow };
+}
+
+// In the order of FormatTag
+const FormatKernels formatKernels[formatTagCount] = {
+	makeFormatKernels<pbmFormat, unsigned char, 1>(),
+	makeFormatKernels<pgmFormat, unsigned char, 1>(),
+	makeFormatKernels<pgmFormat, unsigned short, 1>(),
+	makeFormatKernels<ppmFormat, unsigned char, 1>(),
+	makeFormatKernels<ppmFormat, unsigned short, 1>(),
+	makeFormatKernels<ppmFormat, unsigned char, 3>(),
+	makeFormatKernels<ppmFormat, unsigned short, 3>(),
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include "Bitmap.h"
+#include "PointOps.h"
+#include "Writer.h"
+
+/* Every decision that depends on the kind of an image - whether its pixels are bits, bytes or 16-bit numbers,
+and whether a pixel has one value or three - is made once, when the header of the file is read, and stored as
+a FormatTag. The operations that touch every pixel are templates of the file format, the type of the values and
+the number of channels, and their versions for the seven possible combinations are collected in one table.
+A command looks up the functions for its image once and then runs loops in which nothing depends on the
+format any more, so the compiler can unroll and vectorise them. */
+
+enum ImageFormat
+{
+	pbmFormat,
+	pgmFormat,
+	ppmFormat,
+};
+
+enum FormatTag
+{
+	pbmBitsTag,   // .pbm - one bit per pixel (see Bitmap.h)
+	pgm8Tag,      // .pgm - one byte per pixel
+	pgm16Tag,     // .pgm - one 16-bit value per pixel
+	ppmGray8Tag,  // .ppm after grayscale or monochrome - one value per pixel, written as three equal values
+	ppmGray16Tag,
+	ppmRGB8Tag,   // .ppm - three values per pixel
+	ppmRGB16Tag,
+	formatTagCount,
+};
+
+// sampleSize is the number of bytes in one value (see getSampleSize in Kernels.h) and channels the number of
+// values in one pixel. Neither of them matters for .pbm images.
+FormatTag getFormatTag(ImageFormat format, size_t sampleSize, size_t channels);
+
+// The functions work on rows of width pixels. Columns are counted in pixels, even when the pixels are bits.
+struct FormatKernels
+{
+	ImageFormat format;
+	size_t sampleSize;   // The number of bytes in one value
+	size_t channels;     // The number of values in one pixel
+	size_t pixelSize;    // The number of bytes in one pixel, or 0 when the pixels are bits
+	size_t rawPixelSize; // The number of bytes in one pixel of a raw file, or 0 for bits
+	bool rawLayout;      // Whether the rows already have the layout of the raw format (8-bit values, no expansion)
+
+	// Applies compiled point operations to rowCount rows that are next to each other. With a reduction the rows
+	// of dst have one channel, otherwise they have the layout of src. dst can be the same as src.
+	void (*applyPointOps)(const PointOpsPass& pass, const unsigned char* src, unsigned char* dst, size_t rowCount,
+		size_t width, unsigned short maxValue);
+	// Swaps the pixels of two rows in reverse order: the first pixel of one with the last pixel of the other, and so on.
+	// When both are the same row, the row is reversed. scratch must have room for two rows.
+	void (*swapReversedRows)(unsigned char* first, unsigned char* second, size_t width, unsigned char* scratch);
+	// Writes the pixels of src to dst in reverse order. src and dst must not overlap.
+	void (*reverseRow)(const unsigned char* src, unsigned char* dst, size_t width);
+	// Copies count pixels, starting at column srcColumn of src, to the pixels starting at column dstColumn of dst
+	void (*copyPixels)(const unsigned char* src, size_t srcColumn, unsigned char* dst, size_t dstColumn, size_t count);
+	// Sets count pixels, starting at column dstColumn, to black
+	void (*fillBlack)(unsigned char* dst, size_t dstColumn, size_t count);
+	// Transposes the columns from firstColumn to (firstColumn + columnCount) of height rows of src into the rows
+	// with the same numbers of dst (see transpose in Transpose.h). For bits, firstColumn must be a multiple of 8.
+	void (*transposeColumns)(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+		size_t firstColumn, size_t columnCount, size_t height);
+	// Writes one row of a plain file. scratch must have room for a row with three values per pixel.
+	void (*writePlainRow)(Writer& os, const unsigned char* row, size_t width, unsigned char* scratch);
+	// Converts one row into the layout of the raw format, which has rawPixelSize bytes per pixel. The row and
+	// dst must be aligned for the type of the values.
+	void (*packRawRow)(const unsigned char* row, unsigned char* dst, size_t width);
+};
+
+extern const FormatKernels formatKernels[formatTagCount];
+
+inline const FormatKernels& getFormatKernels(FormatTag tag)
+{
+	return formatKernels[tag];
+}
+
+// The number of bytes in a row of width pixels in memory
+inline size_t getFormatRowSize(const FormatKernels& kernels, size_t width)
+{
+	return kernels.pixelSize == 0 ? getBitRowSize(width) : width * kernels.pixelSize;
+}
@@ -0,0 +1,333 @@
+#include "Generator.h"
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// xorshift64*, started from the seed through splitmix64, so that similar seeds still give unrelated images
+	class Random
+	{
+	private:
+		uint64_t state;
+
+	public:
+		explicit Random(uint64_t seed)
+		{
+			uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			this->state = (z ^ (z >> 31)) | 1;
+		}
+
+		uint64_t next()
+		{
+			this->state ^= this->state >> 12;
+			this->state ^= this->state << 25;
+			this->state ^= this->state >> 27;
+			return this->state * 0x2545F4914F6CDD1Dull;
+		}
+	};
+
+	const char* styleNames[] = { "regular", "token-per-line", "long-lines", "commented", "irregular" };
+	const size_t maxLineLength = 70;
+
+	// A token or separator padded to a fixed size, so it is always copied with one move of that size and only its
+	// length decides how far the output advances. That keeps the formatting free of branches that depend on the
+	// random separators.
+	template <size_t Size>
+	struct Padded
+	{
+		char text[Size];
+		size_t length;
+
+		Padded(const char* text = "") : text(), length(std::strlen(text))
+		{
+			std::memcpy(this->text, text, this->length);
+		}
+	};
+
+	typedef Padded<8> Digits;
+	typedef Padded<40> Separator;
+
+	// The separators of irregularWrap. Every one of them contains whitespace or ends with a line break, so
+	// two tokens never run together.
+	const Separator irregularSeparators[] = { " ", "  ", "\t", "\r\n", "\n\n", " \n", "\t \r\n", "\n# a comment 1 2 3\n", " #comment\r\n" };
+	const size_t irregularSeparatorCount = sizeof(irregularSeparators) / sizeof(irregularSeparators[0]);
+	const Separator space = " ";
+	const Separator lineBreak = "\n";
+	const Separator comments[] = { " # 255 0 1\n", "\n# a comment between values 7 8 9\n" };
+
+	// The digits of every byte value
+	struct DigitTable
+	{
+		Digits values[256];
+
+		DigitTable()
+		{
+			for (unsigned i = 0; i < 256; i++)
+			{
+				this->values[i] = Digits(std::to_string(i).c_str());
+			}
+		}
+	};
+
+	const DigitTable digitTable;
+
+	// Fills a row with random values. The values of .pbm images are bits, eight in a byte, and the values of
+	// other images are spread evenly over [0, maxValue] by scaling 16 random bits at a time.
+	template <typename Sample>
+	void fillRow(Random& random, Sample* row, size_t count, unsigned short maxValue)
+	{
+		size_t i = 0;
+		while (i < count)
+		{
+			uint64_t bits = random.next();
+			for (int j = 0; j < 4 && i < count; j++, i++, bits >>= 16)
+			{
+				row[i] = (Sample)(((bits & 0xFFFF) * (maxValue + 1u)) >> 16);
+			}
+		}
+	}
+
+	void fillBytes(Random& random, unsigned char* row, size_t count)
+	{
+		for (size_t i = 0; i < count; i += 8)
+		{
+			const uint64_t bits = random.next();
+			std::memcpy(row + i, &bits, count - i < 8 ? count - i : 8);
+		}
+	}
+
+	// Formats the values of one row of a plain file, with the separators of any style other than regularWrap,
+	// into text, and returns the number of characters. column is the length of the current line, which goes on
+	// from row to row. The characters are written through a pointer into a buffer that has room for the padded
+	// digits and separator of every value, because that is much faster than growing the buffer.
+	size_t formatRow(const GeneratorOptions& options, Random& layout, const unsigned char* bits, const unsigned short* values,
+		size_t count, size_t& column, std::vector<char>& text)
+	{
+		const size_t maxTokenLength = sizeof(Digits::text) + sizeof(Separator::text);
+		if (text.size() < count * maxTokenLength)
+		{
+			text.resize(count * maxTokenLength);
+		}
+		char* dst = text.data();
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned value = bits != nullptr ? (bits[i / 8] >> (7 - i % 8)) & 1 : values[i];
+			size_t length;
+			if (value < 256)
+			{
+				std::memcpy(dst, digitTable.values[value].text, sizeof(Digits::text));
+				length = digitTable.values[value].length;
+			}
+			else
+			{
+				length = std::to_chars(dst, dst + sizeof(Digits::text), value).ptr - dst;
+			}
+			dst += length;
+			const Separator* separator = &space;
+			switch (options.wrapStyle)
+			{
+			case tokenPerLine:
+				separator = &lineBreak;
+				break;
+			case commentedWrap:
+				// Every value is followed by a comment with a probability of 1 / 32, either at the end of the line of
+				// the value or on a line of its own. The comments contain numbers, which must not be read as values.
+				if ((layout.next() & 31) == 0)
+				{
+					separator = &comments[layout.next() & 1];
+				}
+				else if (column + length + 1 + 5 > maxLineLength || i + 1 == count)
+				{
+					// The line is broken when the next value might not fit, which takes at most five digits
+					separator = &lineBreak;
+				}
+				break;
+			case irregularWrap:
+				separator = &irregularSeparators[layout.next() % irregularSeparatorCount];
+				break;
+			default:
+				break;
+			}
+			std::memcpy(dst, separator->text, sizeof(Separator::text));
+			dst += separator->length;
+			column = separator->text[separator->length - 1] == '\n' ? 0 : column + length + separator->length;
+		}
+		return dst - text.data();
+	}
+
+	// The header in the given style. It always ends with exactly one whitespace character, as raw files require.
+	void writeHeader(Writer& os, const GeneratorOptions& options, Random& layout)
+	{
+		const bool isBitmap = options.magicNumber == 1 || options.magicNumber == 4;
+		const unsigned tokens[] = { (unsigned)options.magicNumber, options.width, options.height, options.maxValue };
+		const size_t tokenCount = isBitmap ? 3 : 4;
+		const std::string seedComment = "# generated with seed " + std::to_string(options.seed) + "\n";
+		for (size_t i = 0; i < tokenCount; i++)
+		{
+			if (i == 0)
+			{
+				os.put('P');
+			}
+			os.writeNumber(tokens[i]);
+			std::string separator = " ";
+			switch (options.wrapStyle)
+			{
+			case regularWrap:
+				separator = i == 0 ? "\n" + seedComment : (i == 1 ? " " : "\n");
+				break;
+			case tokenPerLine:
+				separator = "\n";
+				break;
+			case longLines:
+				separator = " ";
+				break;
+			case commentedWrap:
+				separator = i == 0 ? " " + seedComment + "# the width and the height 1 2\n" : (i == 1 ? " # width\n" : "\n# another comment\n");
+				break;
+			case irregularWrap:
+				separator = irregularSeparators[layout.next() % irregularSeparatorCount].text;
+				break;
+			}
+			if (i + 1 == tokenCount)
+			{
+				separator = options.wrapStyle == longLines ? " " : "\n";
+			}
+			// Every character goes through put, which keeps track of the length of the line for writeNumbers
+			for (size_t j = 0; j < separator.size(); j++)
+			{
+				os.put(separator[j]);
+			}
+		}
+	}
+}
+
+bool generateImage(Writer& os, const GeneratorOptions& options)
+{
+	const bool isBitmap = options.magicNumber == 1 || options.magicNumber == 4;
+	if (options.magicNumber < 1 || options.magicNumber > 6 || options.width == 0 || options.height == 0
+		|| (options.maxValue == 0 && !isBitmap) || options.wrapStyle < regularWrap || options.wrapStyle > irregularWrap)
+	{
+		return false;
+	}
+	// The separators come from a generator of their own, so the pixels depend only on the seed and every wrapping
+	// style of the same seed gives the same image
+	Random random(options.seed);
+	Random layout(~options.seed);
+	writeHeader(os, options, layout);
+
+	const bool isPlain = options.magicNumber <= 3;
+	const size_t count = (size_t)options.width * (options.magicNumber % 3 == 0 ? 3 : 1);
+	const bool isWide = !isBitmap && options.maxValue > 255; // Two bytes per value in raw files
+	std::vector<unsigned char> bits(isBitmap ? (options.width + 7) / 8 : 0);
+	std::vector<unsigned char> bytes(!isBitmap && !isWide ? count : 0);
+	std::vector<unsigned short> values(!isBitmap && (isWide || (isPlain && options.wrapStyle != regularWrap)) ? count : 0);
+	std::vector<unsigned char> raw(!isPlain && isWide ? count * 2 : 0);
+	std::vector<char> text;
+	size_t column = 0;
+
+	for (unsigned y = 0; y < options.height; y++)
+	{
+		if (isBitmap)
+		{
+			fillBytes(random, bits.data(), bits.size());
+		}
+		else if (isWide)
+		{
+			fillRow(random, values.data(), count, options.maxValue);
+		}
+		else if (options.maxValue == 255)
+		{
+			fillBytes(random, bytes.data(), count);
+		}
+		else
+		{
+			fillRow(random, bytes.data(), count, options.maxValue);
+		}
+
+		if (!isPlain)
+		{
+			if (isBitmap)
+			{
+				os.write(bits.data(), bits.size());
+			}
+			else if (isWide)
+			{
+				// The values of 16-bit raw files are big-endian
+				for (size_t i = 0; i < count; i++)
+				{
+					raw[2 * i] = (unsigned char)(values[i] >> 8);
+					raw[2 * i + 1] = (unsigned char)values[i];
+				}
+				os.write(raw.data(), raw.size());
+			}
+			else
+			{
+				os.write(bytes.data(), bytes.size());
+			}
+		}
+		else if (options.wrapStyle == regularWrap)
+		{
+			// The same layout as the files saved by Image, so the fast formatting of the writer does the work
+			if (isBitmap)
+			{
+				os.writeBits(bits.data(), options.width);
+			}
+			else if (isWide)
+			{
+				os.writeNumbers(values.data(), count, 1);
+			}
+			else
+			{
+				os.writeNumbers(bytes.data(), count, 1);
+			}
+			os.endLine();
+		}
+		else
+		{
+			if (!isBitmap && !isWide)
+			{
+				std::copy(bytes.begin(), bytes.end(), values.begin());
+			}
+			const size_t length = formatRow(options, layout, isBitmap ? bits.data() : nullptr, values.data(), isBitmap ? options.width : count, column, text);
+			os.write(text.data(), length);
+		}
+	}
+	if (isPlain && options.wrapStyle == longLines)
+	{
+		os.endLine();
+	}
+	return true;
+}
+
+bool generateImage(const std::string& filePath, const GeneratorOptions& options)
+{
+	Writer os;
+	if (!os.open(filePath))
+	{
+		return false;
+	}
+	const bool generated = generateImage(os, options);
+	return os.close() && generated;
+}
+
+const char* getWrapStyleName(WrapStyle wrapStyle)
+{
+	return wrapStyle >= regularWrap && wrapStyle <= irregularWrap ? styleNames[wrapStyle] : "unknown";
+}
+
+bool parseWrapStyle(const std::string& name, WrapStyle& wrapStyle)
+{
+	for (int i = regularWrap; i <= irregularWrap; i++)
+	{
+		if (name == styleNames[i])
+		{
+			wrapStyle = (WrapStyle)i;
+			return true;
+		}
+	}
+	return false;
+}
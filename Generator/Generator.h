@@ -0,0 +1,41 @@
+#pragma once
+#include "Writer.h"
+#include <cstdint>
+#include <string>
+
+/* Writes synthetic Netpbm images of any format, size and maximum value, so that large images and unusual files can
+be tested without keeping them in the repository. The pixels are pseudo-random numbers from a seed, so the same
+options always give exactly the same file. The values of the plain formats can be wrapped in several styles, from
+the regular one that Image writes itself to the pathological ones that a reader must accept as well. The pixels
+do not depend on the style, so a file in a pathological style can be checked against the regular one. The rows are
+generated and formatted into the large buffer of a Writer without allocating anything per value, so even files of
+a gigabyte take only seconds. */
+
+// How the tokens of a file are separated. Raw files have only the tokens of their header, and the single
+// whitespace character after the last of them never changes.
+enum WrapStyle
+{
+	regularWrap,   // One space between values, lines of at most 70 characters and every row on a new line
+	tokenPerLine,  // Every token on a line of its own
+	longLines,     // The whole file on one line, with one space between the tokens
+	commentedWrap, // Like regularWrap, with comments between the tokens of the header and every few values
+	irregularWrap, // A random mix of spaces, tabs, "\r\n", empty lines and comments between the tokens
+};
+
+struct GeneratorOptions
+{
+	int magicNumber = 6;               // The digit after the 'P', from 1 to 6
+	unsigned width = 0;
+	unsigned height = 0;
+	unsigned short maxValue = 255;     // Not used for .pbm images, whose maximum value is always 1
+	uint64_t seed = 1;
+	WrapStyle wrapStyle = regularWrap;
+};
+
+// Writes the image and returns false if the options are invalid. The writer is not closed.
+bool generateImage(Writer& os, const GeneratorOptions& options);
+// Writes the image to a new file. Returns false if the options are invalid or the file could not be written.
+bool generateImage(const std::string& filePath, const GeneratorOptions& options);
+
+const char* getWrapStyleName(WrapStyle wrapStyle);
+bool parseWrapStyle(const std::string& name, WrapStyle& wrapStyle); // Returns false for an unknown name
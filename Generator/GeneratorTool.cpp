@@ -0,0 +1,45 @@
+#include "Generator.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/* Writes a synthetic image from the command line, for example to create the large inputs of a loader or streaming test:
+	generate <file> <P1 to P6> <width> <height> [maximum value] [seed] [style]
+The maximum value is 255 and the seed 1 by default. The style is one of regular (the default), token-per-line,
+long-lines, commented and irregular. It is built from this file together with Generator/Generator.cpp and
+Writer/Writer.cpp. */
+
+// Reads a whole number that is at least 1 and at most max. Returns false for anything else.
+bool readNumber(const char* text, unsigned long long max, unsigned long long& value)
+{
+	char* end = nullptr;
+	value = std::strtoull(text, &end, 10);
+	return *text >= '0' && *text <= '9' && *end == '\0' && value >= 1 && value <= max;
+}
+
+int main(int argc, char** argv)
+{
+	GeneratorOptions options;
+	unsigned long long width = 0, height = 0, maxValue = 255, seed = 1;
+	const std::string format = argc > 2 ? argv[2] : "";
+	if (argc < 5 || argc > 8 || format.size() != 2 || format[0] != 'P' || format[1] < '1' || format[1] > '6'
+		|| !readNumber(argv[3], 0xFFFFFFFF, width) || !readNumber(argv[4], 0xFFFFFFFF, height)
+		|| (argc > 5 && !readNumber(argv[5], 65535, maxValue)) || (argc > 6 && !readNumber(argv[6], ~0ull, seed))
+		|| (argc > 7 && !parseWrapStyle(argv[7], options.wrapStyle)))
+	{
+		std::cout << "Usage: " << argv[0] << " <file> <P1 to P6> <width> <height> [maximum value] [seed] [style]\n"
+			<< "The style is regular, token-per-line, long-lines, commented or irregular.\n";
+		return 2;
+	}
+	options.magicNumber = format[1] - '0';
+	options.width = (unsigned)width;
+	options.height = (unsigned)height;
+	options.maxValue = (unsigned short)maxValue;
+	options.seed = seed;
+	if (!generateImage(argv[1], options))
+	{
+		std::cout << "Could not write file " << argv[1] << "\n";
+		return 1;
+	}
+	return 0;
+}
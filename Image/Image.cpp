@@ -1,12 +1,44 @@
 #include "Image.h"
+#include "Transform.h"
+#include "PointOps.h"
+#include "Kernels.h"
+#include "Parallel.h"
+#include "Bitmap.h"
 #include <regex>
+#include <cctype>
+#include <ctime>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// The values of an image are bytes or 16-bit numbers (see getSampleSize in Kernels.h), and the kernels have a
+// version for each of them. This helper takes a buffer of bytes and calls the right version.
+static void expandGray(const unsigned char* gray, unsigned char* rgb, size_t pixelCount, size_t sampleSize)
+{
+	if (sampleSize == 2)
+	{
+		grayToRGB((const unsigned short*)gray, (unsigned short*)rgb, pixelCount);
+	}
+	else
+	{
+		grayToRGB(gray, rgb, pixelCount);
+	}
+}
 
 // Implementation of constructor and access member functions
-Image::Image() : magicNumber{ }, fileExtension(""), filePath(""), width(0), height(0), commandsToSkip(0) { }
+Image::Image() : magicNumber{ }, fileExtension(""), filePath(""), width(0), height(0), maxValue(0), formatTag(ppmRGB8Tag), commandsToSkip(0),
+	loaded(true), sourceWidth(0), sourceHeight(0), sourceLeft(0), sourceTop(0), sourceReversed(false), firstSample(nullptr) { }
 
-Image::Image(const std::string& filePath, const unsigned short& commandsToSkip)
+Image::Image(const std::string& filePath, const unsigned short& commandsToSkip, const bool& headerOnly) : Image()
 {
-	loadImage(filePath);
+	if (headerOnly)
+	{
+		probe(filePath);
+	}
+	else
+	{
+		loadImage(filePath);
+	}
 	this->commandsToSkip = commandsToSkip;
 }
 
@@ -17,6 +49,11 @@ unsigned short Image::getCommandsToSkip() const
 	return this->commandsToSkip;
 }
 
+void Image::setCommandsToSkip(const unsigned short& commandsToSkip)
+{
+	this->commandsToSkip = commandsToSkip;
+}
+
 std::string Image::getFilePath() const
 {
 	return this->filePath;
@@ -35,652 +72,1180 @@ void Image::setFilePath(const std::string& filePath) {
 	}
 }
 
+unsigned short Image::getWidth() const
+{
+	return this->width;
+}
+
+unsigned short Image::getHeight() const
+{
+	return this->height;
+}
+
+unsigned short Image::getMaxValue() const
+{
+	return this->maxValue;
+}
+
+unsigned short Image::getChannels() const
+{
+	return (unsigned short)getKernels().channels;
+}
+
+unsigned short Image::getSampleSize() const
+{
+	return (unsigned short)getKernels().sampleSize;
+}
+
+const FormatKernels& Image::getKernels() const
+{
+	return getFormatKernels(this->formatTag);
+}
+
+size_t Image::getStride() const
+{
+	return getRowSize(this->width);
+}
+
+// The pixels of .pbm images are bits (see Bitmap.h), those of the other formats are bytes or 16-bit numbers.
+size_t Image::getRowSize(size_t columns) const
+{
+	return getFormatRowSize(getKernels(), columns);
+}
+
+bool Image::isPacked() const
+{
+	return this->formatTag == pbmBitsTag;
+}
+
+unsigned char* Image::getData()
+{
+	detachSamples();
+	return this->samples != nullptr ? this->samples->data() : nullptr;
+}
+
+const unsigned char* Image::getData() const
+{
+	return viewRow(0);
+}
+
+unsigned char* Image::getRow(size_t row)
+{
+	detachSamples();
+	return this->samples->data() + row * getStride();
+}
+
+const unsigned char* Image::getRow(size_t row) const
+{
+	return viewRow(row);
+}
+
+const unsigned char* Image::viewRow(size_t row) const
+{
+	return this->firstSample + row * getStride();
+}
+
+// The pixels are copied only once, by the first command that changes them. Commands that process the rows
+// in parallel call this before they start, so that the threads never copy anything. A buffer that no other
+// image uses and that starts with the first pixel already belongs to the image; nobody else can start to
+// share it in the meantime, because that would need a copy of this image.
+void Image::detachSamples()
+{
+	if (this->firstSample == nullptr || (this->mapping == nullptr && this->samples.use_count() == 1 && this->firstSample == this->samples->data()))
+	{
+		return;
+	}
+	setSamples(std::vector<unsigned char>(this->firstSample, this->firstSample + getStride() * this->height));
+}
+
+void Image::setSamples(std::vector<unsigned char>&& buffer)
+{
+	this->samples = std::make_shared<std::vector<unsigned char>>(std::move(buffer));
+	this->mapping.reset();
+	this->firstSample = this->samples->data();
+}
+
+// The image is made of the rows of the raw file source that start at offset. This is possible only when whole
+// rows are used, and only when none of the values is larger than the maximum value, because those would have
+// to be replaced. The 16-bit values of a raw file are stored with the most significant byte first, which is not
+// the order of the processor, so such files are always read. If the file cannot be mapped, false is returned
+// and the caller reads it as usual.
+bool Image::mapSamples(const Image& source, size_t offset)
+{
+	if (!isMappingEnabled() || !source.isRaw() || this->width != source.width || getSampleSize() != 1)
+	{
+		return false;
+	}
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	const size_t size = getStride() * this->height;
+	if (!file->openReadOnly(source.filePath + source.fileExtension) || file->getSize() < offset || file->getSize() - offset < size)
+	{
+		return false;
+	}
+	const unsigned char* first = file->getData() + offset;
+	if (!isPacked() && this->maxValue < 255)
+	{
+		const unsigned char maxValue = (unsigned char)this->maxValue;
+		if (std::any_of(first, first + size, [maxValue](unsigned char sample) { return sample > maxValue; }))
+		{
+			return false;
+		}
+	}
+	this->samples.reset();
+	this->mapping = file;
+	this->firstSample = first;
+	return true;
+}
+
+Pixel Image::getPixel(size_t x, size_t y) const
+{
+	if (isPacked())
+	{
+		const unsigned char value = getBit(getRow(y), x);
+		return Pixel(this->maxValue, value, value, value);
+	}
+	const size_t channels = getChannels();
+	unsigned short values[3];
+	for (size_t i = 0; i < channels; i++)
+	{
+		const unsigned char* sample = getRow(y) + (x * channels + i) * getSampleSize();
+		values[i] = getSampleSize() == 2 ? *(const unsigned short*)sample : *sample;
+	}
+	if (channels == 1)
+	{
+		return Pixel(this->maxValue, values[0], values[0], values[0]);
+	}
+	return Pixel(this->maxValue, values[0], values[1], values[2]);
+}
+
 // The approach to loading the data of an image into an object of the Image class is based on reading 
-// the information from the text format of the images using an input stream.
+// the information from the file using an input stream. The stream is opened in binary mode, because the raw
+// formats (P4, P5, P6) store the pixels as bytes, which a text-mode stream would corrupt on Windows.
 
 void Image::loadImage(const std::string& filePath)
 {
-	std::ifstream is(filePath);
-	if (!is.is_open())
+	Tokenizer is;
+	if (!openImage(filePath, is))
 	{
-		std::cout << "Could not open file " << filePath << "\n";
 		return;
 	}
+	if (mapSamples(*this, is.getOffset()))
+	{
+		this->loaded = true;
+		return;
+	}
+	// The whole buffer is allocated once, and the loaders write the values directly into it.
+	std::vector<unsigned char> buffer(getStride() * this->height, 0);
+	readRows(is, buffer.data(), this->height, 0, this->width);
+	if (!validateSamples(buffer.data(), buffer.size()))
+	{
+		std::cout << "Incorrect pixel values in file " << this->filePath << this->fileExtension << "\n";
+	}
+	setSamples(std::move(buffer));
+	this->loaded = true;
+}
+
+bool Image::openImage(const std::string& filePath, Tokenizer& is)
+{
+	if (!is.open(filePath))
+	{
+		std::cout << "Could not open file " << filePath << "\n";
+		return false;
+	}
 
-	this->filePath = filePath;
-	this->filePath.erase(filePath.size() - 4);
 	this->fileExtension = filePath.substr(filePath.length() - 4, 4);
 	// This program works only with Netpbm, so the following check is necessary:
 	if (this->fileExtension != ".pbm" && this->fileExtension != ".pgm" && this->fileExtension != ".ppm")
 	{
 		std::cout << "Could not recognize the file format\n";
-		return;
+		return false;
 	}
 
-	do
+	this->width = 0;
+	this->height = 0;
+	this->maxValue = 1;
+	this->samples.reset();
+	this->mapping.reset();
+	this->firstSample = nullptr;
+	if (!readHeader(is))
 	{
-		is.getline(this->magicNumber, 3);
-		this->magicNumber[2] = '\0';
-	} while (this->magicNumber[0] == '#'); // Sometimes the text format of the files contains comments that start with the '#' character. 
+		std::cout << "Invalid header in file " << filePath << "\n";
+		return false;
+	}
+	this->filePath = filePath;
+	this->filePath.erase(filePath.size() - 4);
+	return true;
+}
 
-	char buffer[26];
-	do
+void Image::probe(const std::string& filePath)
+{
+	Tokenizer is;
+	if (!openImage(filePath, is))
 	{
-		is.getline(buffer, 26);
-	} while (buffer[0] == '#');
+		return;
+	}
+	this->loaded = false;
+	this->sourcePath = filePath;
+	this->sourceWidth = this->width;
+	this->sourceHeight = this->height;
+	this->sourceLeft = 0;
+	this->sourceTop = 0;
+	this->sourceReversed = false;
+	this->pendingPointOps.clear();
+}
 
-	size_t i = 0;
-	while (buffer[i] != ' ')
+bool Image::isLoaded() const
+{
+	return this->loaded;
+}
+
+// Only the area of the file that makes up the image is decoded: the rows above it are skipped (raw files
+// are simply sought past them), only its columns are decoded and the reading stops after its last row.
+// So a crop that was recorded before loading also makes the loading cheaper.
+void Image::load()
+{
+	if (this->loaded)
 	{
-		(this->width *= 10) += (int)buffer[i] - 48; //Changing text into a number
-		i++;
+		return;
+	}
+	Image source;
+	Tokenizer is;
+	if (!source.openImage(this->sourcePath, is))
+	{
+		return;
 	}
-	i++;
-	while (buffer[i] != '\0')
+	if (source.width != this->sourceWidth || source.height != this->sourceHeight)
 	{
-		(this->height *= 10) += (int)buffer[i] - 48;
-		i++;
+		std::cout << "The file " << this->sourcePath << " has changed since it was opened\n";
+		return;
+	}
+	// When nothing has to be done to the pixels while loading, the rows of a raw .ppm file are used in place.
+	if (!this->sourceReversed && this->pendingPointOps.isEmpty() && mapSamples(source, is.getOffset() + this->sourceTop * source.getStride()))
+	{
+		this->loaded = true;
+		return;
 	}
-	unsigned short maxValue = 0;
+	std::vector<unsigned char> buffer(getStride() * this->height, 0);
+	if (source.skipRows(is, this->sourceTop))
+	{
+		source.readRows(is, buffer.data(), this->height, this->sourceLeft, this->width);
+	}
+	if (!source.validateSamples(buffer.data(), buffer.size()))
+	{
+		std::cout << "Incorrect pixel values in file " << this->sourcePath << "\n";
+	}
+	setSamples(std::move(buffer));
+	this->loaded = true;
 
-	// The three formats have a similar text structure, but there are some key differences that require a slightly different 
-	// approach. For example, in .pbm files there is no maximum value for the pixels as there is in the other two formats; 
-	// in .ppm, in addition to having a maximum pixel value, each pixel has different values for red, green, and blue 
-	// colors, whereas in the other two formats, the pixels have only one value each.
-	if (this->fileExtension == ".pbm")
+	if (this->sourceReversed)
 	{
-		loadPBMAndPGM(is, 1);
+		flipHorizontal();
 	}
-	else
+	applyPointOps(this->pendingPointOps);
+	this->pendingPointOps.clear();
+}
+
+// The three formats have a similar structure, but there are some key differences that require a slightly different 
+// approach. For example, in .pbm files there is no maximum value for the pixels as there is in the other two formats; 
+// in .ppm, in addition to having a maximum pixel value, each pixel has different values for red, green, and blue 
+// colors, whereas in the other two formats, the pixels have only one value each. On top of that, every format
+// has a plain (text) and a raw (binary) variant, distinguished by the digit in the magic number.
+bool Image::readRows(Tokenizer& is, unsigned char* dst, size_t rowCount, size_t left, size_t columns)
+{
+	switch (this->magicNumber[1])
 	{
-		is.getline(buffer, 26);
+	case '1':
+	case '2':
+		return loadPBMAndPGM(is, dst, rowCount, left, columns);
+	case '3':
+		return loadPPM(is, dst, rowCount, left, columns);
+	case '4':
+		return loadRawPBM(is, dst, rowCount, left, columns);
+	default:
+		return loadRawPGMAndPPM(is, dst, rowCount, left, columns);
+	}
+}
 
-		for (size_t i = 0; buffer[i] != '\0'; i++)
-		{
-			(maxValue *= 10) += (int)buffer[i] - 48;
-		}
+// In the raw formats every row has the same number of bytes, so the rows are skipped without being read.
+// In the plain formats the values are only scanned, without storing them.
+bool Image::skipRows(Tokenizer& is, size_t rowCount)
+{
+	bool skipped;
+	switch (this->magicNumber[1])
+	{
+	case '1':
+		skipped = is.skipBits(rowCount * this->width);
+		break;
+	case '2':
+		skipped = is.skipNumbers(rowCount * this->width);
+		break;
+	case '3':
+		skipped = is.skipNumbers(rowCount * this->width * 3);
+		break;
+	case '4':
+		skipped = is.skipBytes(rowCount * ((this->width + 7) / 8));
+		break;
+	default:
+		skipped = is.skipBytes(rowCount * getRawRowSize());
+		break;
+	}
+	if (!skipped)
+	{
+		std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+	}
+	return skipped;
+}
 
-		if (this->fileExtension == ".pgm")
-		{
-			loadPBMAndPGM(is, maxValue);
-		}
-		else
+// Replaces the values larger than maxValue with 0 and returns false if there were any
+template <typename Sample>
+static bool replaceInvalidSamples(Sample* samples, size_t count, unsigned short maxValue)
+{
+	bool valid = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (samples[i] > maxValue)
 		{
-			loadPPM(is, maxValue);
+			samples[i] = 0;
+			valid = false;
 		}
 	}
-	this->pixels.shrink_to_fit();
+	return valid;
 }
 
+// Every value in the image must be between 0 and the maximum value. Instead of checking every single value
+// while reading it, I check the whole buffer (or row) once after loading. Invalid values are replaced with 0.
+bool Image::validateSamples(unsigned char* samples, size_t size) const
+{
+	if (this->maxValue == 255 || this->maxValue == 65535 || isPacked())
+	{
+		return true; // A byte or a 16-bit number cannot hold a larger value anyway, and neither can a bit
+	}
+	if (getSampleSize() == 2)
+	{
+		return replaceInvalidSamples((unsigned short*)samples, size / 2, this->maxValue);
+	}
+	return replaceInvalidSamples(samples, size, this->maxValue);
+}
 
-// Just like when reading, when writing files we use a stream, but this time for output.
-void Image::saveImage()
+// The header of every Netpbm file consists of the magic number, the width, the height and (except for .pbm) the maximum 
+// value, separated by whitespace. Comments that start with the '#' character can appear between any of them.
+bool Image::readHeader(Tokenizer& is)
 {
-	std::string newFilePath = getNewFileName();
+	unsigned value = 0;
+	if (!readHeaderValue(is, value, true) || value < 1 || value > 6)
+	{
+		return false;
+	}
+	this->magicNumber[0] = 'P';
+	this->magicNumber[1] = (char)('0' + value);
+	this->magicNumber[2] = '\0';
 
-	std::ofstream os(newFilePath);
-	if (!os.is_open())
+	// The magic number and the file extension must describe the same format
+	const char* expectedDigits = this->fileExtension == ".pbm" ? "14" : (this->fileExtension == ".pgm" ? "25" : "36");
+	if (this->magicNumber[1] != expectedDigits[0] && this->magicNumber[1] != expectedDigits[1])
 	{
-		std::cout << "Could not open file " << newFilePath << "\n";
-		return;
+		return false;
 	}
+	const ImageFormat format = this->fileExtension == ".pbm" ? pbmFormat : (this->fileExtension == ".pgm" ? pgmFormat : ppmFormat);
 
-	os << this->magicNumber << "\r";
-	os << this->width << " " << this->height << "\r";
+	if (!readHeaderValue(is, value) || value < 1 || value > 65535)
+	{
+		return false;
+	}
+	this->width = value;
+	if (!readHeaderValue(is, value) || value < 1 || value > 65535)
+	{
+		return false;
+	}
+	this->height = value;
 
-	// Just like when reading, the structure of the files is similar, 
-	// but the aforementioned differences must be observed 
-	if (this->fileExtension == ".pbm" || this->fileExtension == ".pgm")
+	if (this->fileExtension != ".pbm")
 	{
-		if (this->fileExtension == ".pgm")
+		if (!readHeaderValue(is, value) || value < 1 || value > 65535)
 		{
-			os << this->pixels[0].getMaxValue() << "\r";
+			return false;
 		}
-		for (size_t i = 0; i < pixels.size(); i++)
+		this->maxValue = value;
+	}
+	// From here on nothing has to compare the file extension or the maximum value to find out how the pixels are stored
+	this->formatTag = getFormatTag(format, ::getSampleSize(this->maxValue), format == ppmFormat ? 3 : 1);
+
+	// In the raw formats exactly one whitespace character separates the header from the pixels, 
+	// while in the plain formats any amount of whitespace (and comments) can follow, which the tokenizer skips.
+	if (isRaw())
+	{
+		return is.get() != EOF;
+	}
+	return true;
+}
+
+bool Image::readHeaderValue(Tokenizer& is, unsigned& value, bool isMagicNumber)
+{
+	int c = is.get();
+	while (c != EOF && (std::isspace(c) || c == '#'))
+	{
+		if (c == '#')
 		{
-			os << pixels[i].getRValue();
-			if ((i + 1) % width == 0)
+			while (c != EOF && c != '\n' && c != '\r')
 			{
-				os << "\r";
-			}
-			else
-			{
-				os << " ";
+				c = is.get();
 			}
 		}
+		c = is.get();
 	}
-	else
+	if (isMagicNumber)
 	{
-		os << this->pixels[0].getMaxValue() << "\r";
-		for (size_t i = 0; i < pixels.size(); i++)
+		if (c != 'P')
 		{
-			os << pixels[i].getRValue() << " " << pixels[i].getGValue() << " " << pixels[i].getBValue() << "\r";
+			return false;
 		}
+		c = is.get();
 	}
-}
-
-// Since the only difference in the text format of .pbm and .pgm is whether the pixels have a maximum value or not,
-// I combined the reading of the two files into one function. Although the pixels in .pbm do not have a specified maximum value in 
-// the documentation, it is always 1.
-void Image::loadPBMAndPGM(std::ifstream& is, const short& maxValue)
-{
-	for (size_t i = 0; i < this->height; i++)
+	if (c == EOF || !std::isdigit(c))
+	{
+		return false;
+	}
+	value = c - '0';
+	// The character after the number is part of the separator, so I only peek at it
+	// in order not to consume the single whitespace before the pixels of the raw formats.
+	while (is.peek() != EOF && std::isdigit(is.peek()))
 	{
-		unsigned int size = this->width * 4;// In .pgm, we have a maximum of width times three-digit values for the pixels + (width - 1) times space between them + one '\0' character.
-		char* buffer = new char[size];
-		unsigned short pixelValue = 0;
-		is.getline(buffer, size);
-		for (size_t j = 0; j < size; j++)
+		(value *= 10) += is.get() - '0'; //Changing text into a number
+		if (value > 65535)
 		{
-			while (buffer[j] != ' ' && buffer[j] != '\0')
-			{
-				(pixelValue *= 10) += (int)buffer[j] - 48;
-				j++;
-			}
-			Pixel pixel(maxValue, pixelValue, pixelValue, pixelValue);
-			pixels.push_back(pixel);
-			pixelValue = 0;
-			if (buffer[j] == '\0')
-			{
-				break;
-			}
+			return false;
 		}
-		delete[] buffer;
 	}
+	return true;
 }
 
-void Image::loadPPM(std::ifstream& is, const short& maxValue)
+bool Image::isRaw() const
 {
-	const unsigned int pixelCount = this->height * this->width;
-	for (size_t i = 0; i < pixelCount; i++)
-	{
-		const unsigned int buffSize = 27; // In .ppm, we have a maximum of width times three-digit values for the pixels + (width - 1) times space between them + one '\0' character.
-		char* buffer = new char[buffSize];
-		unsigned short values[3] = { 0,0,0 };
-		size_t t = 0;
-		is.getline(buffer, buffSize);
-		for (size_t j = 0; buffer[j] != '\0'; j++)
-		{
-			if (buffer[j] == ' ')
-			{
-				continue;
-			}
-			while (buffer[j] != ' ' && buffer[j] != '\0')
-			{
-				(values[t] *= 10) += (int)buffer[j] - 48;
-				j++;
-			}
-			t++;
-			if (buffer[j] == '\0')
-			{
-				break;
-			}
-		}
+	return this->magicNumber[1] >= '4';
+}
 
-		Pixel pixel(maxValue, values[0], values[1], values[2]);
-		pixels.push_back(pixel);
-		delete[] buffer;
-	}
+
+// Just like when reading, when writing files we use a buffer, but this time for output.
+// The file is written in the same format (plain or raw) that it was loaded in.
+void Image::saveImage()
+{
+	saveImage(getNewFileName());
 }
 
-std::string Image::getNewFileName()
+bool Image::saveImage(const std::string& newFilePath)
 {
-	unsigned long long currentTime = std::time(nullptr); // I use a long long variable to prevent data loss
-	std::string newFileName = this->filePath;
-	newFileName.append("_").append(std::to_string(currentTime));
-	newFileName += this->fileExtension;
-	return newFileName;
+	// An image must not overwrite the file it reads from - a released image saved again within the same second,
+	// or a batch job that writes over its input - so its pixels are copied into memory first.
+	if (!this->loaded && this->sourcePath == newFilePath)
+	{
+		load();
+	}
+	// The same goes for a loaded image whose pixels are still in a mapping of that file
+	if (this->mapping != nullptr && (this->sourcePath == newFilePath || this->filePath + this->fileExtension == newFilePath))
+	{
+		detachSamples();
+	}
+	// The size of a raw file is known in advance, so a loaded image is written straight into a mapping of the file
+	if (this->loaded && isRaw() && isMappingEnabled() && saveMapped(newFilePath))
+	{
+		this->savedPath = newFilePath;
+		return true;
+	}
+	Writer os;
+	if (!os.open(newFilePath))
+	{
+		std::cout << "Could not open file " << newFilePath << "\n";
+		return false;
+	}
+	if (!saveImage(os))
+	{
+		std::cout << "Could not write file " << newFilePath << "\n";
+		return false;
+	}
+	this->savedPath = newFilePath;
+	return true;
 }
 
-void Image::toGrayscale()
+// The saved file contains exactly the pixels of the image, so the image becomes a probe of that file. It keeps
+// its name, and the pixels are read again only if another command needs them or it is saved once more.
+void Image::release()
 {
-	if (this->fileExtension == ".pbm" || this->fileExtension == ".pgm")
+	if (this->savedPath.empty())
 	{
 		return;
 	}
-	size_t imgSize = this->width * this->height;
-	for (size_t i = 0; i < imgSize; i++)
+	Image saved;
+	saved.probe(this->savedPath);
+	if (saved.loaded)
 	{
-		// The following formula for achieving the grayscale appearance of the image is taken from:
-		//https://learn.microsoft.com/en-us/previous-versions/bb332387(v=msdn.10)?redirectedfrom=MSDN#tbconimagecolorizer_grayscaleconversion
-
-		unsigned short grayValue = 0.299 * this->pixels[i].getRValue() + 0.587 * this->pixels[i].getGValue() + 0.114 * this->pixels[i].getBValue();
-		unsigned short maxValue = this->pixels[i].getMaxValue();
-		Pixel newPixel(maxValue, grayValue, grayValue, grayValue);
-		this->pixels[i] = newPixel;
+		return; // The file could not be opened, so the pixels stay in memory
 	}
+	saved.filePath = this->filePath;
+	saved.commandsToSkip = this->commandsToSkip;
+	saved.savedPath = this->savedPath;
+	*this = saved;
 }
 
-void Image::toMonochrome()
+bool Image::saveImage(Writer& os)
 {
-	// .pbm images are monochrome anyway, so there is no need to change them.
-	if (this->fileExtension == ".pbm")
+	if (!this->loaded)
 	{
-		return;
+		saveStreamed(os);
 	}
-	size_t imgSize = this->width * this->height;
-	for (size_t i = 0; i < imgSize; i++)
+	else
 	{
-		// To convert the images to monochrome(composed of only black or white pixels), I find the average value
-		// of the colors that make up the pixel and check whether it is closer to white (the maximum value) 
-		// or black (value 0) in the image.
-		unsigned short avgValue = (this->pixels[i].getRValue() + this->pixels[i].getGValue() + this->pixels[i].getBValue()) / 3;
-		unsigned short maxValue = this->pixels[i].getMaxValue();
-		unsigned short monoValue = 0;
-		if (avgValue >= maxValue / 2)
-		{
-			monoValue = maxValue;
-		}
+		writeHeader(os);
+		writeRows(os, viewRow(0), this->height, this->formatTag);
+	}
+	return os.close();
+}
 
-		Pixel newPixel(maxValue, monoValue, monoValue, monoValue);
-		this->pixels[i] = newPixel;
+void Image::writeHeader(Writer& os) const
+{
+	os.write(this->magicNumber, 2);
+	os.endLine();
+	os.writeNumber(this->width);
+	os.put(' ');
+	os.writeNumber(this->height);
+	os.endLine();
+	if (!isPacked())
+	{
+		os.writeNumber(this->maxValue);
+		os.endLine();
 	}
 }
 
-void Image::toNegative()
+// The rows have the layout of rowFormat, which is not always the layout of the image: when an image that is not
+// loaded is saved, its rows become gray only after they are read.
+void Image::writeRows(Writer& os, const unsigned char* rows, size_t rowCount, FormatTag rowFormat) const
 {
-	size_t imgSize = this->width * this->height;
-	for (size_t i = 0; i < imgSize; i++)
+	const FormatKernels& kernels = getFormatKernels(rowFormat);
+	const size_t stride = getFormatRowSize(kernels, this->width);
+	if (!isRaw())
 	{
-		// To obtain the opposite values of the images, for each color we need to replace the value with 
-		// the absolute difference between the maximum value and the current one.
-		unsigned short maxValue = this->pixels[i].getMaxValue();
-		unsigned short newRValue = std::abs(maxValue - this->pixels[i].getRValue());
-		unsigned short newGValue = std::abs(maxValue - this->pixels[i].getGValue());
-		unsigned short newBValue = std::abs(maxValue - this->pixels[i].getBValue());
+		// Every row starts on a new line, and long rows are wrapped so that no line is longer than 70 characters.
+		// The values of .pbm files are written without separators, the others are separated by spaces.
+		// A gray .ppm image still has to be written with three values per pixel, which the kernel expands into the buffer.
+		std::vector<unsigned char> buffer(this->width * 3 * kernels.sampleSize);
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			kernels.writePlainRow(os, rows + i * stride, this->width, buffer.data());
+			os.endLine();
+		}
+		return;
+	}
 
-		Pixel newPixel(maxValue, newRValue, newGValue, newBValue);
-		this->pixels[i] = newPixel;
+	if (kernels.rawLayout)
+	{
+		// The rows already have the layout of the raw format, so they are written as they are.
+		os.write(rows, rowCount * stride);
+		return;
+	}
+	// Gray .ppm rows and 16-bit rows are converted one at a time and then written with a single call.
+	std::vector<unsigned char> row(getRawRowSize());
+	for (size_t i = 0; i < rowCount; i++)
+	{
+		kernels.packRawRow(rows + i * stride, row.data(), this->width);
+		os.write(row.data(), row.size());
 	}
 }
 
-// Several helper functions for the implementation of the following member functions
-void initMatrix(Pixel**& matrix, const unsigned short& rowsCount, const unsigned short& colsCount)
+size_t Image::getRawRowSize() const
 {
-	matrix = new Pixel * [rowsCount];
-	for (size_t i = 0; i < rowsCount; i++)
+	const size_t rawPixelSize = getKernels().rawPixelSize;
+	return rawPixelSize == 0 ? getBitRowSize(this->width) : this->width * rawPixelSize;
+}
+
+// Converts rows of the image into the layout of the raw format: gray rows of a .ppm image are expanded,
+// and 16-bit values get the byte order of the file.
+void Image::packRawRows(unsigned char* dst, const unsigned char* rows, size_t rowCount, FormatTag rowFormat) const
+{
+	const FormatKernels& kernels = getFormatKernels(rowFormat);
+	const size_t stride = getFormatRowSize(kernels, this->width);
+	const size_t rowSize = getRawRowSize();
+	if (kernels.rawLayout)
+	{
+		std::memcpy(dst, rows, rowCount * stride);
+		return;
+	}
+	// The rows of a mapped file start after a header of any length, so 16-bit values can be at odd addresses there.
+	// The kernels only work on aligned values, so such rows are packed into an aligned row and copied from it.
+	if (kernels.sampleSize == 2 && (uintptr_t)dst % sizeof(unsigned short) != 0)
 	{
-		matrix[i] = new Pixel[colsCount];
+		std::vector<unsigned short> row(rowSize / sizeof(unsigned short));
+		for (size_t i = 0; i < rowCount; i++)
+		{
+			kernels.packRawRow(rows + i * stride, (unsigned char*)row.data(), this->width);
+			std::memcpy(dst + i * rowSize, row.data(), rowSize);
+		}
+		return;
+	}
+	for (size_t i = 0; i < rowCount; i++)
+	{
+		kernels.packRawRow(rows + i * stride, dst + i * rowSize, this->width);
 	}
 }
 
-void deleteMatrix(Pixel** matrix, const unsigned short& rowsCount)
+// The header is formatted in memory first, because its length decides the size of the file. The rows are
+// then converted directly into the mapping, in parallel stripes for large images.
+bool Image::saveMapped(const std::string& filePath) const
 {
-	for (size_t i = 0; i < rowsCount; i++)
+	std::vector<char> header;
+	Writer os;
+	os.open(header);
+	writeHeader(os);
+	os.close();
+
+	const size_t rowSize = getRawRowSize();
+	MappedFile file;
+	if (!file.create(filePath, header.size() + rowSize * this->height))
 	{
-		delete[] matrix[i];
+		return false;
 	}
-	delete[] matrix;
+	std::memcpy(file.getData(), header.data(), header.size());
+	unsigned char* dst = file.getData() + header.size();
+	parallelFor(this->height, this->width, [&](size_t firstRow, size_t lastRow) {
+		packRawRows(dst + firstRow * rowSize, viewRow(firstRow), lastRow - firstRow, this->formatTag);
+	});
+	return file.close();
 }
 
-
-// For rotating and achieving a mirrored image of the images, I use a temporary dynamic two-dimensional array, 
-// as indexing is convenient for such manipulation.
-void Image::rotateLeft()
+// An image that is not loaded is saved by reading its source file one row at a time. The rows above the
+// area of the image are skipped, and the reading stops after its last row. Only the columns of the area are
+// decoded, the row is reversed if needed, the recorded point operations are applied to it and it is written at once.
+void Image::saveStreamed(Writer& os)
 {
-	std::swap(this->height, this->width);
-
-	Pixel** temp = nullptr;
-	initMatrix(temp, this->height, this->width);
+	Image source;
+	Tokenizer is;
+	if (!source.openImage(this->sourcePath, is))
+	{
+		return;
+	}
+	if (source.width != this->sourceWidth || source.height != this->sourceHeight)
+	{
+		std::cout << "The file " << this->sourcePath << " has changed since it was opened\n";
+		return;
+	}
+	writeHeader(os);
 
-	for (size_t col = 0; col < this->width; col++)
+	const PointOpsPass pass = this->pendingPointOps.compile(this->maxValue, isPacked(), getChannels());
+	const FormatKernels& kernels = getKernels();
+	// After a reduction the rows that are written are gray
+	const FormatTag rowFormat = pass.reduction == noReduction ? this->formatTag : getFormatTag(kernels.format, kernels.sampleSize, 1);
+	std::vector<unsigned char> sourceRow(getStride());
+	std::vector<unsigned char> row(getStride());
+	bool valid = true;
+	if (!source.skipRows(is, this->sourceTop))
 	{
-		for (int row = this->height - 1; row >= 0; row--)
+		return;
+	}
+	for (size_t i = 0; i < this->height; i++)
+	{
+		std::fill(sourceRow.begin(), sourceRow.end(), 0);
+		if (!source.readRows(is, sourceRow.data(), 1, this->sourceLeft, this->width))
 		{
-			temp[row][col] = this->pixels.front();
-			this->pixels.erase(this->pixels.begin());
+			return;
 		}
-	}
+		valid = source.validateSamples(sourceRow.data(), sourceRow.size()) && valid;
 
-	for (size_t row = 0; row < this->height; row++)
-	{
-		for (size_t col = 0; col < this->width; col++)
+		if (this->sourceReversed)
+		{
+			kernels.reverseRow(sourceRow.data(), row.data(), this->width);
+		}
+		else
 		{
-			this->pixels.push_back(temp[row][col]);
+			row.swap(sourceRow);
 		}
+		kernels.applyPointOps(pass, row.data(), row.data(), 1, this->width, this->maxValue);
+		writeRows(os, row.data(), 1, rowFormat);
+	}
+	if (!valid)
+	{
+		std::cout << "Incorrect pixel values in file " << this->sourcePath << "\n";
 	}
-
-	deleteMatrix(temp, this->height);
 }
-void Image::rotateRight()
-{
-	std::swap(this->height, this->width);
 
-	Pixel** temp = nullptr;
-	initMatrix(temp, this->height, this->width);
+// Reads count values of a plain file into a buffer of bytes or of 16-bit numbers
+bool Image::readValues(Tokenizer& is, unsigned char* dst, size_t count) const
+{
+	return getSampleSize() == 2 ? is.readNumbers((unsigned short*)dst, count, 1) : is.readNumbers(dst, count, 1);
+}
 
-	for (int col = this->width - 1; col >= 0; col--)
+// Since the only difference in the text format of .pbm and .pgm is whether the pixels have a maximum value or not,
+// I combined the reading of the two files into one function. Although the pixels in .pbm do not have a specified maximum value in 
+// the documentation, it is always 1. The tokenizer does not care how the values are split into lines, and the values of
+// every row are written directly to their place in the buffer.
+bool Image::loadPBMAndPGM(Tokenizer& is, unsigned char* dst, size_t rowCount, size_t left, size_t columns)
+{
+	const bool isBitmap = this->magicNumber[1] == '1';
+	const size_t right = this->width - left - columns;
+	// The values of .pbm files are read as bytes, which are then packed into bits
+	std::vector<unsigned char> bits(isBitmap ? columns : 0);
+	for (size_t i = 0; i < rowCount; i++)
 	{
-		for (int row = 0; row < this->height; row++)
+		unsigned char* pixel = dst + i * getRowSize(columns);
+		const bool read = isBitmap
+			? is.skipBits(left) && is.readBits(bits.data(), columns, 1) && is.skipBits(right)
+			: is.skipNumbers(left) && readValues(is, pixel, columns) && is.skipNumbers(right);
+		if (read && isBitmap)
+		{
+			packBits(bits.data(), 1, pixel, columns);
+		}
+		if (!read)
 		{
-			temp[row][col] = this->pixels.front();
-			this->pixels.erase(this->pixels.begin());
+			std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+			return false;
 		}
 	}
+	return true;
+}
 
-	for (size_t row = 0; row < this->height; row++)
+bool Image::loadPPM(Tokenizer& is, unsigned char* dst, size_t rowCount, size_t left, size_t columns)
+{
+	const size_t right = this->width - left - columns;
+	for (size_t i = 0; i < rowCount; i++)
 	{
-		for (size_t col = 0; col < this->width; col++)
+		if (!is.skipNumbers(left * 3) || !readValues(is, dst + i * getRowSize(columns), columns * 3) || !is.skipNumbers(right * 3))
 		{
-			this->pixels.push_back(temp[row][col]);
+			std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+			return false;
 		}
 	}
-
-	deleteMatrix(temp, this->height);
+	return true;
 }
 
-void Image::flipHorizontal()
+// The raw formats are read one whole row at a time into a buffer of bytes, instead of parsing every value separately.
+// Only the bytes that contain the columns of the area are read; the stream is moved past the others.
+bool Image::loadRawPBM(Tokenizer& is, unsigned char* dst, size_t rowCount, size_t left, size_t columns)
 {
-	Pixel** temp = nullptr;
-	initMatrix(temp, this->height, this->width);
-
-	for (int row = 0; row < this->height; row++)
+	const size_t rowBytes = getBitRowSize(this->width);
+	if (left == 0 && columns == this->width)
 	{
-		for (int col = this->width - 1; col >= 0; col--)
+		// The rows have exactly the layout of the buffer, so they are read directly into it. Only the unused
+		// bits at the end of every row are cleared, because the file may contain anything there.
+		if (!is.readBytes(dst, rowCount * rowBytes))
+		{
+			std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+			return false;
+		}
+		if (this->width % 8 != 0)
 		{
-			temp[row][col] = this->pixels.front();
-			this->pixels.erase(this->pixels.begin());
+			for (size_t i = 1; i <= rowCount; i++)
+			{
+				dst[i * rowBytes - 1] &= (unsigned char)(0xFF00 >> (this->width % 8));
+			}
 		}
+		return true;
 	}
 
-	for (size_t row = 0; row < this->height; row++)
+	// Otherwise the bits of the columns are shifted to the beginning of the rows of the buffer
+	const size_t firstByte = left / 8;
+	const size_t lastByte = getBitRowSize(left + columns);
+	std::vector<unsigned char> row(lastByte - firstByte);
+	for (size_t i = 0; i < rowCount; i++)
 	{
-		for (size_t col = 0; col < this->width; col++)
+		if (!is.skipBytes(firstByte) || !is.readBytes(row.data(), row.size()) || !is.skipBytes(rowBytes - lastByte))
 		{
-			this->pixels.push_back(temp[row][col]);
+			std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+			return false;
 		}
+		copyBits(row.data(), left % 8, dst + i * getBitRowSize(columns), 0, columns);
 	}
-
-	deleteMatrix(temp, this->height);
+	return true;
 }
-void Image::flipVertical()
-{
-	Pixel** temp = nullptr;
-	initMatrix(temp, this->height, this->width);
 
-	for (int row = this->height - 1; row >= 0; row--)
+bool Image::loadRawPGMAndPPM(Tokenizer& is, unsigned char* dst, size_t rowCount, size_t left, size_t columns)
+{
+	// The rows of P5 and P6 files have exactly the layout of the buffer, except that 16-bit values
+	// have their most significant byte first and are converted after reading.
+	const size_t pixelSize = getKernels().pixelSize;
+	if (left == 0 && columns == this->width)
 	{
-		for (int col = 0; col < this->width; col++)
+		// Whole rows are read directly into the buffer at once
+		if (!is.readBytes(dst, rowCount * getStride()))
 		{
-			temp[row][col] = this->pixels.front();
-			this->pixels.erase(this->pixels.begin());
+			std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+			return false;
 		}
 	}
-
-	for (size_t row = 0; row < this->height; row++)
+	else
 	{
-		for (size_t col = 0; col < this->width; col++)
+		for (size_t i = 0; i < rowCount; i++)
 		{
-			this->pixels.push_back(temp[row][col]);
+			if (!is.skipBytes(left * pixelSize) || !is.readBytes(dst + i * columns * pixelSize, columns * pixelSize) || !is.skipBytes((this->width - left - columns) * pixelSize))
+			{
+				std::cout << "Unexpected end of file " << this->filePath << this->fileExtension << "\n";
+				return false;
+			}
 		}
 	}
+	if (getSampleSize() == 2)
+	{
+		convertBigEndian((unsigned short*)dst, rowCount * columns * getChannels());
+	}
+	return true;
+}
 
-	deleteMatrix(temp, this->height);
+std::string Image::getNewFileName()
+{
+	unsigned long long currentTime = std::time(nullptr); // I use a long long variable to prevent data loss
+	std::string newFileName = this->filePath;
+	newFileName.append("_").append(std::to_string(currentTime));
+	newFileName += this->fileExtension;
+	return newFileName;
 }
 
-Image makeCollage(const std::string& orientation, const Image& img1, const Image& img2)
+// Grayscale, monochrome and negative are point operations, so each of them is a chain
+// of one operation that is executed by applyPointOps.
+void Image::toGrayscale()
 {
-	// When creating a new image that is a collage of two other images, there are member variables 
-	// that do not depend on the orientation of the collage. They are brought to the forefront 
-	// in the member function makeCollage.
-	Image collage;
-	collage.filePath = img1.filePath.substr(img1.filePath.rfind('\\') + 1) + '_' + img2.filePath.substr(img2.filePath.rfind('\\') + 1);
-	collage.fileExtension = img1.fileExtension;
-	collage.magicNumber[0] = 'P';
-	if (img1.fileExtension == ".pbm")
+	PointOps operations;
+	operations.add(grayscaleOperation);
+	applyPointOps(operations);
+}
+
+void Image::toMonochrome()
+{
+	PointOps operations;
+	operations.add(monochromeOperation);
+	applyPointOps(operations);
+}
+
+void Image::toNegative()
+{
+	PointOps operations;
+	operations.add(negativeOperation);
+	applyPointOps(operations);
+}
+
+void Image::applyPointOps(const PointOps& operations)
+{
+	if (!this->loaded)
 	{
-		collage.magicNumber[1] = '1';
+		this->pendingPointOps.add(operations);
+		return;
 	}
-	else if (img1.fileExtension == ".pgm")
+	const PointOpsPass pass = operations.compile(this->maxValue, isPacked(), getChannels());
+	const FormatKernels& kernels = getKernels();
+	if (pass.identity)
 	{
-		collage.magicNumber[1] = '2';
+		return;
 	}
-	else if (img1.fileExtension == ".ppm")
+	if (pass.reduction != noReduction)
 	{
-		collage.magicNumber[1] = '3';
+		// A color image becomes gray, so it is reduced into a new buffer with one value per pixel,
+		// which uses a third of the memory from now on.
+		std::vector<unsigned char> gray((size_t)this->width * this->height * getSampleSize());
+		parallelFor(this->height, this->width, [&](size_t firstRow, size_t lastRow) {
+			kernels.applyPointOps(pass, viewRow(firstRow), gray.data() + firstRow * this->width * getSampleSize(), lastRow - firstRow, this->width, this->maxValue);
+		});
+		setSamples(std::move(gray));
+		this->formatTag = getFormatTag(kernels.format, kernels.sampleSize, 1);
+		return;
 	}
-	collage.magicNumber[2] = '\0';
-	collage.commandsToSkip = 0;
+	// The rows are processed in stripes, in parallel for large images (see Parallel.h).
+	detachSamples();
+	parallelFor(this->height, this->width, [&](size_t firstRow, size_t lastRow) {
+		kernels.applyPointOps(pass, getRow(firstRow), getRow(firstRow), lastRow - firstRow, this->width, this->maxValue);
+	});
+}
+
+// Every rotation and flip is one of the eight elements of a Transform, so the four commands
+// are implemented by the same function.
+void Image::rotateLeft()
+{
+	Transform rotation;
+	rotation.rotateLeft();
+	transform(rotation);
+}
+void Image::rotateRight()
+{
+	Transform rotation;
+	rotation.rotateRight();
+	transform(rotation);
+}
+
+void Image::flipHorizontal()
+{
+	Transform flip;
+	flip.flipHorizontal();
+	transform(flip);
+}
+void Image::flipVertical()
+{
+	Transform flip;
+	flip.flipVertical();
+	transform(flip);
+}
 
-	Pixel blackPixel;
-	if (collage.fileExtension == ".pbm")
+// Whatever the transformation is, every pixel is moved exactly once.
+void Image::transform(const Transform& transformation)
+{
+	if (transformation.isIdentity())
 	{
-		blackPixel = Pixel(1, 1, 1, 1);
+		return;
 	}
-	else
+	if (!this->loaded)
 	{
-		blackPixel = Pixel(img1.pixels[0].getMaxValue(), 0, 0, 0);
+		// A horizontal flip only reverses the rows, so it can be applied while streaming.
+		// Everything else needs the whole image.
+		if (!transformation.isTransposed() && !transformation.isFlippedVertically())
+		{
+			this->sourceReversed = !this->sourceReversed;
+			return;
+		}
+		load();
 	}
-
-	if (orientation == "horizontal")
+	if (this->firstSample == nullptr)
 	{
-		// The approach to creating a horizontal collage is as follows:
-		collage.width = img1.width + img2.width;
-		int heightDifference = img1.height - img2.height;
+		return;
+	}
 
-		if (heightDifference == 0)
+	if (!transformation.isTransposed())
+	{
+		// Without a transposition the size of the image stays the same, so the pixels are moved in place:
+		// for the horizontal flip the pixels of every row are reversed, for the vertical flip the rows
+		// are swapped pairwise, and for both (a rotation by 180 degrees) the pixels of every pair of rows
+		// are swapped in reverse order. Every row or pair of rows is independent, so large images are
+		// processed in parallel stripes.
+		detachSamples();
+		const bool flipH = transformation.isFlippedHorizontally();
+		const bool flipV = transformation.isFlippedVertically();
+		const FormatKernels& kernels = getKernels();
+		const size_t stride = getStride();
+		if (flipH)
 		{
-			// If the two images are of the same size, one row from the first image and one row from the second image 
-			// are sequentially recorded in the pixel vector of the collage.
-			collage.height = img1.height;
-			for (size_t i = 0; i < img1.height; i++)
-			{
-				for (size_t j = 0; j < img1.width; j++)
+			// The middle row of an image with an odd height is paired with itself, so it is only reversed.
+			// The rows of .pbm images are reversed through the scratch buffer (see Format.h).
+			parallelFor(flipV ? (this->height + 1) / 2 : this->height, flipV ? 2 * this->width : this->width, [&](size_t first, size_t last) {
+				std::vector<unsigned char> scratch(isPacked() ? 2 * stride : 0);
+				for (size_t top = first; top < last; top++)
 				{
-					collage.pixels.push_back(img1.pixels[i * img1.width + j]);
+					const size_t bottom = flipV ? this->height - 1 - top : top;
+					kernels.swapReversedRows(getRow(top), getRow(bottom), this->width, scratch.data());
 				}
-				for (size_t j = 0; j < img2.width; j++)
-				{
-					collage.pixels.push_back(img2.pixels[i * img2.width + j]);
-				}
-			}
+			});
 		}
 		else
 		{
-			unsigned short blackRowsTop = 0, blackRowsBottom = 0;
-			if (heightDifference < 0)
-			{
-				// If the second image has a greater height, a row of black pixels is recorded in the pixel vector 
-				// of the collage, followed by a row from the second image. This is repeated (heightDifference / 2) 
-				// times. Then, one row from the first image is recorded, followed by one row from the second image, 
-				// and this continues until all rows from the first image are recorded. Finally, a row of black pixels 
-				// is recorded again, followed by a row from the second image. This is repeated (heightDifference / 2) 
-				// or (heightDifference / 2) + 1 times depending on whether heightDifference is an even or odd number.
-				heightDifference = abs(heightDifference);
-				blackRowsBottom = heightDifference / 2;
-				blackRowsTop = heightDifference / 2;
-				if (heightDifference % 2 != 0)
+			parallelFor(this->height / 2, 2 * this->width, [&](size_t firstPair, size_t lastPair) {
+				for (size_t top = firstPair; top < lastPair; top++)
 				{
-					blackRowsBottom++;
+					std::swap_ranges(getRow(top), getRow(top) + stride, getRow(this->height - 1 - top));
 				}
+			});
+		}
+		return;
+	}
 
-				collage.height = img2.height;
-				for (size_t i = 0; i < img2.height; i++)
-				{
-					if (blackRowsTop > i)
-					{
-						for (size_t j = 0; j < img1.width; j++)
-						{
-							collage.pixels.push_back(blackPixel);
-						}
-					}
-					else if (blackRowsBottom >= img2.height - i)
-					{
-						for (size_t j = 0; j < img1.width; j++)
-						{
-							collage.pixels.push_back(blackPixel);
-						}
-					}
-					else
-					{
-						for (size_t j = 0; j < img1.width; j++)
-						{
-							collage.pixels.push_back(img1.pixels[(i - blackRowsTop) * img1.width + j]);
-						}
-					}
-					for (size_t j = 0; j < img2.width; j++)
-					{
-						collage.pixels.push_back(img2.pixels[i * img2.width + j]);
-					}
-				}
-			}
-			else
-			{
-				// The approach when the first image has a greater height than the second is similar, just executed in reverse.
-				blackRowsBottom = heightDifference / 2;
-				blackRowsTop = heightDifference / 2;
-				if (heightDifference % 2 != 0)
-				{
-					blackRowsBottom++;
-				}
+	// With a transposition the image changes its size, so the pixels are written into one preallocated
+	// buffer, which then replaces the buffer of the image. The flips that follow the transposition are
+	// part of the same pass: a horizontal flip of the result is a transposition of the source read from
+	// its last row upwards, and a vertical flip of the result is a transposition written from the last
+	// row of the destination upwards (see Transpose.h).
+	const ptrdiff_t stride = (ptrdiff_t)getStride();
+	const ptrdiff_t newStride = (ptrdiff_t)getRowSize(this->height);
+	std::vector<unsigned char> transposed(newStride * this->width);
 
-				collage.height = img1.height;
-				for (size_t i = 0; i < img1.height; i++)
-				{
-					for (size_t j = 0; j < img1.width; j++)
-					{
-						collage.pixels.push_back(img1.pixels[i * img1.width + j]);
-					}
-					if (blackRowsTop > i)
-					{
-						for (size_t j = 0; j < img2.width; j++)
-						{
-							collage.pixels.push_back(blackPixel);
-						}
-					}
-					else if (blackRowsBottom >= img1.height - i)
-					{
-						for (size_t j = 0; j < img2.width; j++)
-						{
-							collage.pixels.push_back(blackPixel);
-						}
-					}
-					else
-					{
-						for (size_t j = 0; j < img2.width; j++)
-						{
-							collage.pixels.push_back(img2.pixels[(i - blackRowsTop) * img2.width + j]);
-						}
-					}
-				}
-			}
-		}
+	const unsigned char* src = viewRow(0);
+	ptrdiff_t srcStride = stride;
+	if (transformation.isFlippedHorizontally())
+	{
+		src = viewRow(this->height - 1);
+		srcStride = -stride;
 	}
-	else if (orientation == "vertical")
+	unsigned char* dst = transposed.data();
+	ptrdiff_t dstStride = newStride;
+	if (transformation.isFlippedVertically())
 	{
-		collage.height = img1.height + img2.height;
-		int widthDifference = img1.width - img2.width;
+		dst += (this->width - 1) * newStride;
+		dstStride = -newStride;
+	}
+	// The columns of the source are split into bands of whole tiles. Every band becomes a band of rows
+	// of the destination, so the threads never write to the same rows. The bands of .pbm images start
+	// at whole bytes, and their bits are transposed in blocks of 8 x 8 (see Bitmap.h).
+	const size_t bandWidth = 64;
+	const FormatKernels& kernels = getKernels();
+	parallelFor((this->width + bandWidth - 1) / bandWidth, bandWidth * this->height, [&](size_t firstBand, size_t lastBand) {
+		const size_t firstColumn = firstBand * bandWidth;
+		const size_t lastColumn = std::min<size_t>(lastBand * bandWidth, this->width);
+		kernels.transposeColumns(src, srcStride, dst, dstStride, firstColumn, lastColumn - firstColumn, this->height);
+	});
+
+	setSamples(std::move(transposed));
+	std::swap(this->height, this->width);
+}
+
+// Helper function that writes one part of a row of a collage, starting at column dstColumn: blackBefore black
+// pixels, width pixels of a row of one of the images (or black pixels, when the image has no row there) and
+// blackAfter black pixels. The row already has the layout of the collage (see convertCollageRow), and what black
+// is depends on the format, so the kernels of the collage do the work. It returns the column right after the part.
+size_t writeCollageRow(const FormatKernels& kernels, unsigned char* dst, size_t dstColumn, const unsigned char* src,
+	const size_t& width, const size_t& blackBefore, const size_t& blackAfter)
+{
+	kernels.fillBlack(dst, dstColumn, blackBefore);
+	dstColumn += blackBefore;
+	if (src != nullptr)
+	{
+		kernels.copyPixels(src, 0, dst, dstColumn, width);
+	}
+	else
+	{
+		kernels.fillBlack(dst, dstColumn, width);
+	}
+	dstColumn += width;
+	kernels.fillBlack(dst, dstColumn, blackAfter);
+	return dstColumn + blackAfter;
+}
 
-		if (widthDifference == 0)
+// The values of the collage have the size of the values of the first image, and a collage of a color and a gray
+// .ppm image is a color image. A row of width pixels with the layout from is converted into buffer when it
+// differs from the layout to: values of another size are converted first (the values that are larger than the
+// maximum value of the collage are limited to it), and gray rows are then expanded to three values per pixel.
+// It returns the row that has the layout of the collage.
+const unsigned char* convertCollageRow(const unsigned char* src, const size_t& width, const FormatKernels& from,
+	const FormatKernels& to, const unsigned short& maxValue, std::vector<unsigned char>& buffer)
+{
+	if (src == nullptr || (from.sampleSize == to.sampleSize && from.channels == to.channels))
+	{
+		return src;
+	}
+	const size_t count = width * from.channels;
+	// The expanded row goes after the converted values
+	buffer.resize(count * to.sampleSize + width * to.pixelSize);
+	if (from.sampleSize != to.sampleSize && to.sampleSize == 2)
+	{
+		std::copy(src, src + count, (unsigned short*)buffer.data());
+		src = buffer.data();
+	}
+	else if (from.sampleSize != to.sampleSize)
+	{
+		const unsigned short* values = (const unsigned short*)src;
+		for (size_t i = 0; i < count; i++)
 		{
-			// For vertical collages with equal width, the approach is simple: we first record 
-			// all the pixels from the first image in the pixel vector of the collage, 
-			// followed by all the pixels from the second image.
-			collage.width = img1.width;
-			for (size_t i = 0; i < img1.pixels.size(); i++)
-			{
-				collage.pixels.push_back(img1.pixels[i]);
-			}
-			for (size_t i = 0; i < img2.pixels.size(); i++)
-			{
-				collage.pixels.push_back(img2.pixels[i]);
-			}
+			buffer[i] = (unsigned char)std::min(values[i], maxValue);
 		}
-		else
-		{
-			unsigned short blackColsL = 0, blackColsR = 0;
-			if (widthDifference < 0)
-			{
-				// If the second image has a greater width, the pixel vector of the collage records 
-				// (widthDifference / 2) black pixels, followed by an entire row of pixels from the first image. 
-				// The row of the collage is completed with (widthDifference / 2) or (widthDifference / 2) + 1 
-				// black pixels, depending on whether widthDifference is an even or odd number. 
-				// This is repeated for each row from the first image. After that, all the pixels from the second image 
-				// are recorded in the pixel vector of the collage.
-				widthDifference = abs(widthDifference);
-				blackColsL = widthDifference / 2;
-				blackColsR = widthDifference / 2;
-				if (widthDifference % 2 != 0)
-				{
-					blackColsR++;
-				}
+		src = buffer.data();
+	}
+	if (from.channels == to.channels)
+	{
+		return src;
+	}
+	unsigned char* expanded = buffer.data() + count * to.sampleSize;
+	expandGray(src, expanded, width, to.sampleSize);
+	return expanded;
+}
 
-				collage.width = img2.width;
-				for (size_t i = 0; i < img1.height; i++)
-				{
-					for (size_t j = 0; j < blackColsL; j++)
-					{
-						collage.pixels.push_back(blackPixel);
-					}
-					for (size_t j = 0; j < img1.width; j++)
-					{
-						collage.pixels.push_back(img1.pixels[i * img1.width + j]);
-					}
-					for (size_t j = 0; j < blackColsR; j++)
-					{
-						collage.pixels.push_back(blackPixel);
-					}
-				}
-				for (size_t i = 0; i < img2.pixels.size(); i++)
-				{
-					collage.pixels.push_back(img2.pixels[i]);
-				}
-			}
-			else
+Image makeCollage(const std::string& orientation, const Image& img1, const Image& img2)
+{
+	// When creating a new image that is a collage of two other images, there are member variables 
+	// that do not depend on the orientation of the collage. They are brought to the forefront 
+	// in the member function makeCollage.
+	Image collage;
+	collage.filePath = img1.filePath.substr(img1.filePath.rfind('\\') + 1) + '_' + img2.filePath.substr(img2.filePath.rfind('\\') + 1);
+	collage.fileExtension = img1.fileExtension;
+	// The collage is saved in the same variant (plain or raw) as the first image.
+	collage.magicNumber[0] = img1.magicNumber[0];
+	collage.magicNumber[1] = img1.magicNumber[1];
+	collage.magicNumber[2] = '\0';
+	collage.commandsToSkip = 0;
+
+	collage.maxValue = img1.maxValue;
+	// A collage of a color and a gray .ppm image is a color image
+	collage.formatTag = getFormatTag(img1.getKernels().format, img1.getSampleSize(), std::max(img1.getChannels(), img2.getChannels()));
+	const FormatKernels& kernels = collage.getKernels();
+
+	// The size of the collage is known in advance, so every row of the collage is written directly to its place
+	// in the buffer. The rows do not depend on each other, so large collages are assembled in parallel stripes.
+	if (orientation == "horizontal")
+	{
+		// In a horizontal collage every row consists of a row from the first image followed by a row from
+		// the second image. When one of the images is lower than the other, it is centered vertically:
+		// (heightDifference / 2) rows of black pixels are placed above it and (heightDifference / 2) or
+		// (heightDifference / 2) + 1 rows below it, depending on whether heightDifference is an even or odd number.
+		collage.width = img1.width + img2.width;
+		collage.height = std::max(img1.height, img2.height);
+		const size_t blackRowsTop1 = (collage.height - img1.height) / 2;
+		const size_t blackRowsTop2 = (collage.height - img2.height) / 2;
+		collage.setSamples(std::vector<unsigned char>(collage.getStride() * collage.height));
+
+		parallelFor(collage.height, collage.width, [&](size_t firstRow, size_t lastRow) {
+			std::vector<unsigned char> converted1, converted2;
+			for (size_t i = firstRow; i < lastRow; i++)
 			{
-				// The approach when the first image has a greater width than the second is similar, just executed in reverse.
-				blackColsL = widthDifference / 2;
-				blackColsR = widthDifference / 2;
-				if (widthDifference % 2 != 0)
-				{
-					blackColsR++;
-				}
+				const unsigned char* row1 = i >= blackRowsTop1 && i - blackRowsTop1 < img1.height ? img1.getRow(i - blackRowsTop1) : nullptr;
+				const unsigned char* row2 = i >= blackRowsTop2 && i - blackRowsTop2 < img2.height ? img2.getRow(i - blackRowsTop2) : nullptr;
+				row1 = convertCollageRow(row1, img1.width, img1.getKernels(), kernels, collage.maxValue, converted1);
+				row2 = convertCollageRow(row2, img2.width, img2.getKernels(), kernels, collage.maxValue, converted2);
+				unsigned char* dst = collage.getRow(i);
+				const size_t column = writeCollageRow(kernels, dst, 0, row1, img1.width, 0, 0);
+				writeCollageRow(kernels, dst, column, row2, img2.width, 0, 0);
+			}
+		});
+	}
+	else if (orientation == "vertical")
+	{
+		// In a vertical collage all rows of the first image are followed by all rows of the second image.
+		// When one of the images is narrower than the other, it is centered horizontally:
+		// (widthDifference / 2) black pixels are placed before each of its rows and (widthDifference / 2)
+		// or (widthDifference / 2) + 1 black pixels after it, depending on whether widthDifference is an even or odd number.
+		collage.height = img1.height + img2.height;
+		collage.width = std::max(img1.width, img2.width);
+		const size_t blackColsL1 = (collage.width - img1.width) / 2;
+		const size_t blackColsR1 = collage.width - img1.width - blackColsL1;
+		const size_t blackColsL2 = (collage.width - img2.width) / 2;
+		const size_t blackColsR2 = collage.width - img2.width - blackColsL2;
+		collage.setSamples(std::vector<unsigned char>(collage.getStride() * collage.height));
 
-				collage.width = img1.width;
-				for (size_t i = 0; i < img1.pixels.size(); i++)
+		parallelFor(collage.height, collage.width, [&](size_t firstRow, size_t lastRow) {
+			std::vector<unsigned char> converted;
+			for (size_t i = firstRow; i < lastRow; i++)
+			{
+				if (i < img1.height)
 				{
-					collage.pixels.push_back(img1.pixels[i]);
+					const unsigned char* row1 = convertCollageRow(img1.getRow(i), img1.width, img1.getKernels(), kernels, collage.maxValue, converted);
+					writeCollageRow(kernels, collage.getRow(i), 0, row1, img1.width, blackColsL1, blackColsR1);
 				}
-				for (size_t i = 0; i < img2.height; i++)
+				else
 				{
-					for (size_t j = 0; j < blackColsL; j++)
-					{
-						collage.pixels.push_back(blackPixel);
-					}
-					for (size_t j = 0; j < img2.width; j++)
-					{
-						collage.pixels.push_back(img2.pixels[i * img2.width + j]);
-					}
-					for (size_t j = 0; j < blackColsR; j++)
-					{
-						collage.pixels.push_back(blackPixel);
-					}
+					const unsigned char* row2 = convertCollageRow(img2.getRow(i - img1.height), img2.width, img2.getKernels(), kernels,
+						collage.maxValue, converted);
+					writeCollageRow(kernels, collage.getRow(i), 0, row2, img2.width, blackColsL2, blackColsR2);
 				}
 			}
-		}
+		});
 	}
 	return collage;
 }
 
 void Image::crop(unsigned short xTL, unsigned short yTL, unsigned short xBR, unsigned short yBR)
 {
+	crop(xTL, yTL, xBR, yBR, Transform());
+}
+
+void Image::crop(unsigned short xTL, unsigned short yTL, unsigned short xBR, unsigned short yBR, const Transform& transformation)
+{
+	// The coordinates refer to the transformed image, which is transposed if the transformation is.
+	const unsigned short width = transformation.isTransposed() ? this->height : this->width;
+	const unsigned short height = transformation.isTransposed() ? this->width : this->height;
+
 	// It is possible to provide coordinates for the top right or bottom left point, as well as coordinates 
 	// that do not form a rectangle (overlapping coordinates).
-	if (yTL >= this->height)
+	if (yTL >= height)
 	{
-		yTL = this->height - 1;
+		yTL = height - 1;
 	}
-	if (yBR >= this->height)
+	if (yBR >= height)
 	{
-		yBR = this->height - 1;
+		yBR = height - 1;
 	}
-	if (xTL >= this->width)
+	if (xTL >= width)
 	{
-		xTL = this->width - 1;
+		xTL = width - 1;
 	}
-	if (xBR >= this->width)
+	if (xBR >= width)
 	{
-		xBR = this->width - 1;
+		xBR = width - 1;
 	}
 
 	if (xTL > xBR)
@@ -696,21 +1261,63 @@ void Image::crop(unsigned short xTL, unsigned short yTL, unsigned short xBR, uns
 		std::cout << "Cannot crop image " << this->filePath << " in this size. Try another values\n";
 		return;
 	}
-	unsigned short newHeight = yTL - yBR;
-	unsigned short newWidth = xBR - xTL;
+	size_t newHeight = yTL - yBR;
+	size_t newWidth = xBR - xTL;
+	size_t left = xTL;
+	size_t top = height - yTL;
+
+	// The area is mapped back through the transformation, undoing its steps in reverse order: the flips
+	// mirror the area, and the transposition swaps its columns with its rows.
+	if (transformation.isFlippedVertically())
+	{
+		top = height - top - newHeight;
+	}
+	if (transformation.isFlippedHorizontally())
+	{
+		left = width - left - newWidth;
+	}
+	if (transformation.isTransposed())
+	{
+		std::swap(left, top);
+		std::swap(newWidth, newHeight);
+	}
 
-	std::vector<Pixel> temp;
+	if (!this->loaded)
+	{
+		// Only the area of the source file that makes up the image changes. When the rows of the area
+		// are reversed, the columns of the crop are counted from its right side.
+		this->sourceLeft += (unsigned short)(this->sourceReversed ? this->width - left - newWidth : left);
+		this->sourceTop += (unsigned short)top;
+		this->width = (unsigned short)newWidth;
+		this->height = (unsigned short)newHeight;
+		return;
+	}
+	cropArea(left, top, newWidth, newHeight);
+}
 
-	int index = (this->height - yTL) * this->width + xTL;
-	for (size_t i = 0; i < newHeight; i++)
+void Image::cropArea(size_t left, size_t top, size_t newWidth, size_t newHeight)
+{
+	// A crop of whole rows only moves the view of the mapping or of the buffer, which may be shared with
+	// the snapshots of the image, so such a crop uses no memory at all.
+	if (this->firstSample != nullptr && left == 0 && newWidth == this->width)
 	{
-		for (size_t j = 0; j < newWidth; j++)
+		this->firstSample += top * getStride();
+		this->height = (unsigned short)newHeight;
+		return;
+	}
+	// The rows of the cropped area are copied into a buffer of the exact new size, which then replaces
+	// the buffer of the image. The rows do not overlap, so large areas are copied in parallel stripes.
+	const size_t newStride = getRowSize(newWidth);
+	std::vector<unsigned char> cropped(newStride * newHeight);
+	// The pixels of the area are moved to the beginning of the new rows, and the bits of .pbm images are shifted there.
+	const FormatKernels& kernels = getKernels();
+	parallelFor(newHeight, newWidth, [&](size_t firstRow, size_t lastRow) {
+		for (size_t i = firstRow; i < lastRow; i++)
 		{
-			temp.push_back(this->pixels.at((index + j) + (i * this->width)));
+			kernels.copyPixels(viewRow(top + i), left, cropped.data() + i * newStride, 0, newWidth);
 		}
-	}
-	this->pixels = temp;
-	this->pixels.shrink_to_fit();
-	this->height = newHeight;
-	this->width = newWidth;
+	});
+	setSamples(std::move(cropped));
+	this->height = (unsigned short)newHeight;
+	this->width = (unsigned short)newWidth;
 }
\ No newline at end of file
@@ -1,7 +1,14 @@
 #pragma once
 #include <fstream>
+#include <memory>
 #include <string>
 #include "Pixel.h"
+#include "Transform.h"
+#include "PointOps.h"
+#include "Tokenizer.h"
+#include "Writer.h"
+#include "MappedFile.h"
+#include "Format.h"
 #include <vector>
 
 /* The most important processes related to image editing take place here, in the Image class.
@@ -24,42 +31,135 @@ protected:
 								// in the code.
 	unsigned short width; // This contains the information about the width of the file
 	unsigned short height; // This contains the information about the height of the file
-	std::vector<Pixel> pixels; // The member variables width and height are important for the number of pixels
-								// that will be stored in the vector pixels
+	unsigned short maxValue; // The maximum value of a color in the image. It is the same for every pixel, 
+							// so it is stored only once. It can be up to 65535, and when it is larger than 255,
+							// every value is a 16-bit number instead of a byte (see getSampleSize).
+	FormatTag formatTag; // The format of the file together with the layout of the pixels in memory (see Format.h).
+						// It is resolved once, when the header is read, and decides the number of values
+						// (samples) that make up one pixel - red, green and blue (3), or a single gray value (1).
+						// .pgm images and .ppm images that have been converted to grayscale or monochrome have
+						// one channel, and so do .pbm images, whose values are stored as single bits (see isPacked).
+	// The values of all pixels, stored row after row in one contiguous buffer. The samples of a pixel are next
+	// to each other (interleaved), so the row with index i starts at i * width * channels * getSampleSize().
+	// 16-bit values are stored in the byte order of the processor. The buffer is reference-counted: a copy of
+	// the image shares it, and it is copied only when one of the images changes its pixels (copy on write).
+	// So copying an image - for a snapshot of a session (see Session::undo) or for the cache of its states -
+	// costs nothing until the pixels actually change.
+	std::shared_ptr<std::vector<unsigned char>> samples;
 	unsigned short commandsToSkip; // This contains information necessary for executing commands
 									// in the main code. The need for this variable arises from the fact that
 									// images can be added to a session at a later stage without applying the previous
 									// commands to them.
 
+	// An image can also be opened without loading its pixels - only the header of the file is read (see probe).
+	// Flips, crops and point operations on such an image are only recorded: they always select a rectangular
+	// area of the file, whose rows may be reversed, and change the values of its pixels. When the image is saved,
+	// the file is read, processed and written one row at a time, so the memory used does not depend on the
+	// size of the image. Any other operation loads the pixels first.
+	bool loaded; // False if only the header has been read
+	std::string sourcePath; // The file from which the pixels of an image that is not loaded are read
+	unsigned short sourceWidth; // The size of the image in that file
+	unsigned short sourceHeight;
+	unsigned short sourceLeft; // The position of the top left corner of the area of the file that makes up the image
+	unsigned short sourceTop;
+	bool sourceReversed; // Whether the rows of the area are reversed (flipped horizontally)
+	PointOps pendingPointOps; // The point operations that are applied to every row when the image is saved
+	std::string savedPath; // The file the image was last saved to, from which it is read again after release
+
+	// The pixels of a raw file with 8-bit values or bits (P4, P5 and P6) already have the layout of the buffer, so
+	// whole rows of such a file are not read at all: the file is mapped into memory and the image uses the pixels
+	// where they are. The buffer is copied out of the mapping (copy on write) only when a command changes the
+	// pixels in place; commands that write a new buffer anyway, such as crops, rotations and collages, read
+	// straight from the mapping.
+	std::shared_ptr<const MappedFile> mapping; // The mapped file, shared with the copies of the image
+	// The first pixel of the image, in the mapping or in samples, or nullptr when there are no pixels. A crop of
+	// whole rows only moves it, so the image can be a view of some of the rows of a shared buffer.
+	const unsigned char* firstSample;
+
 public:
 	// Constructors
 	Image();
-	Image(const std::string& filePath, const unsigned short& commandsToSkip = 0);
+	Image(const std::string& filePath, const unsigned short& commandsToSkip = 0, const bool& headerOnly = false);
 	~Image();
 
 	
 	unsigned short getCommandsToSkip() const;
+	void setCommandsToSkip(const unsigned short& commandsToSkip);
 	std::string getFilePath() const;
 	std::string getFileExtension() const;
 	void setFilePath(const std::string& filePath);
 
+	// Access to the pixel buffer. Kernels that process the whole image can stream over the rows
+	// directly, where row i starts at getData() + i * getStride(). The non-const versions copy the
+	// pixels of a mapped image into its own buffer first.
+	unsigned short getWidth() const;
+	unsigned short getHeight() const;
+	unsigned short getMaxValue() const;
+	unsigned short getChannels() const;
+	unsigned short getSampleSize() const; // The number of bytes in one value - 1, or 2 when the maximum value is above 255
+	size_t getStride() const; // The number of bytes in one row
+	bool isPacked() const; // Whether the pixels are bits (.pbm images, see Bitmap.h) instead of bytes
+	unsigned char* getData();
+	const unsigned char* getData() const;
+	unsigned char* getRow(size_t row);
+	const unsigned char* getRow(size_t row) const;
+	Pixel getPixel(size_t x, size_t y) const; // Convenient, but slow access to a single pixel
+
 	void loadImage(const std::string&);
+	void probe(const std::string&); // Reads only the header of the file, the pixels are read when they are needed
+	bool isLoaded() const;
+	void load(); // Loads the pixels of a probed image and applies the recorded operations to them
 	void saveImage();
+	bool saveImage(const std::string& newFilePath); // Saves to the given file instead of a new name. Returns false on failure.
+	bool saveImage(Writer&); // Writes the image to a file descriptor or to memory instead of a new file
+	void release(); // Frees the pixels of a saved image, which reads them from the saved file when they are needed again
+	bool isRaw() const; // Checks whether the image is in one of the raw (binary) formats - P4, P5 or P6
 
 	// Member functions that perform manipulations on the current image:
 	void toGrayscale();
 	void toMonochrome();
 	void toNegative();
+	void applyPointOps(const PointOps&); // Applies a chain of grayscale, monochrome and negative in a single pass
 	void rotateLeft();
 	void rotateRight();
 	void flipHorizontal();
 	void flipVertical();
+	void transform(const Transform&); // Applies any combination of rotations and flips in a single pass
 	void crop(unsigned short xTL, unsigned short yTL, unsigned short xBR, unsigned short yBR);
+	// Crops the image as it would look after the transformation, without applying the transformation.
+	// Applying it afterwards gives the same result as applying it first and then cropping, but it moves only
+	// the pixels of the cropped area.
+	void crop(unsigned short xTL, unsigned short yTL, unsigned short xBR, unsigned short yBR, const Transform& transformation);
 	friend Image makeCollage(const std::string& orientation, const Image& img1, const Image& img2);
 private:
-	// Helper member functions that facilitate loading and saving the image
-	void loadPBMAndPGM(std::ifstream&, const short&);
-	void loadPPM(std::ifstream&, const short&);
+	// Helper member functions that facilitate loading and saving the image. The pixels are read and written
+	// in rows, so the same functions serve both the whole image and the streaming of a single row.
+	bool openImage(const std::string&, Tokenizer&); // Opens the file and reads its header
+	// The readers can decode only some of the columns of every row: the columns from left to (left + columns)
+	// are written next to each other to dst, and the others are skipped.
+	bool readRows(Tokenizer&, unsigned char* dst, size_t rowCount, size_t left, size_t columns);
+	bool skipRows(Tokenizer&, size_t rowCount); // Moves past rows without decoding them
+	bool readValues(Tokenizer&, unsigned char* dst, size_t count) const; // Bytes or 16-bit numbers, depending on the maximum value
+	bool loadPBMAndPGM(Tokenizer&, unsigned char* dst, size_t rowCount, size_t left, size_t columns);
+	bool loadPPM(Tokenizer&, unsigned char* dst, size_t rowCount, size_t left, size_t columns);
+	bool loadRawPBM(Tokenizer&, unsigned char* dst, size_t rowCount, size_t left, size_t columns);
+	bool loadRawPGMAndPPM(Tokenizer&, unsigned char* dst, size_t rowCount, size_t left, size_t columns);
+	bool readHeader(Tokenizer&);
+	bool validateSamples(unsigned char* samples, size_t size) const; // size is the number of bytes
+	bool readHeaderValue(Tokenizer&, unsigned&, bool isMagicNumber = false);
+	void writeHeader(Writer&) const;
+	void writeRows(Writer&, const unsigned char* rows, size_t rowCount, FormatTag rowFormat) const;
+	void saveStreamed(Writer&); // Saves an image that is not loaded, one row at a time
+	void cropArea(size_t left, size_t top, size_t newWidth, size_t newHeight);
+	size_t getRowSize(size_t columns) const; // The number of bytes in a row of the given number of pixels
+	const FormatKernels& getKernels() const; // The functions that process the pixels of this image
+	const unsigned char* viewRow(size_t row) const; // Read-only access that never copies a mapped image
+	void detachSamples(); // Copies the pixels of a mapped or shared image into its own buffer
+	void setSamples(std::vector<unsigned char>&& buffer); // Replaces the pixels with a new buffer of the exact size
+	bool mapSamples(const Image& source, size_t offset); // Uses the pixels of a raw P4, P5 or P6 file with 8-bit values in place
+	size_t getRawRowSize() const; // The number of bytes in one row of the raw format
+	void packRawRows(unsigned char* dst, const unsigned char* rows, size_t rowCount, FormatTag rowFormat) const;
+	bool saveMapped(const std::string& filePath) const; // Writes a raw file through a mapping of its final size
 	std::string getNewFileName();
 };
 
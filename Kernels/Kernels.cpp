@@ -0,0 +1,813 @@
+#include "Kernels.h"
+#include "Cpu.h"
+#include "PointOps.h"
+
+#ifdef NETPBM_X86
+#include <immintrin.h>
+#endif
+
+// The plain C++ versions. They are also used for the pixels that remain after the last full
+// vector of the vectorised versions.
+template <typename Sample>
+static void rgbToGrayScalar(const Sample* rgb, Sample* gray, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; i++, rgb += 3)
+	{
+		gray[i] = (Sample)toGrayValue(rgb[0], rgb[1], rgb[2]);
+	}
+}
+
+template <typename Sample>
+static void rgbToAverageScalar(const Sample* rgb, Sample* average, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; i++, rgb += 3)
+	{
+		average[i] = (Sample)((rgb[0] + rgb[1] + rgb[2]) / 3);
+	}
+}
+
+template <typename Sample>
+static void grayToRGBScalar(const Sample* gray, Sample* rgb, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; i++, rgb += 3)
+	{
+		rgb[0] = rgb[1] = rgb[2] = gray[i];
+	}
+}
+
+template <typename Sample>
+static void negateScalar(Sample* samples, size_t count, Sample maxValue)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		samples[i] = (Sample)(maxValue - samples[i]);
+	}
+}
+
+template <typename Sample>
+static void thresholdScalar(Sample* samples, size_t count, Sample maxValue)
+{
+	const Sample middle = maxValue / 2;
+	for (size_t i = 0; i < count; i++)
+	{
+		samples[i] = samples[i] >= middle ? maxValue : 0;
+	}
+}
+
+static void convertBigEndianScalar(unsigned short* samples, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		samples[i] = (unsigned short)((samples[i] << 8) | (samples[i] >> 8));
+	}
+}
+
+#ifdef NETPBM_X86
+// The reductions of RGB to one value are weighted sums w1 * red + w2 * green + w3 * blue, shifted right by 16 bits.
+// They are computed with the multiply-add instruction, which multiplies pairs of 16-bit values and adds the two
+// products into a 32-bit value. Its multipliers are signed, so the green weight of the grayscale formula (38470)
+// is split into two parts: (red, green) pairs are multiplied by (w1, g1) and (green, blue) pairs by (g2, w3).
+template <bool Average>
+struct ReductionWeights;
+
+template <>
+struct ReductionWeights<false>
+{
+	static const short redGreen[2];
+	static const short greenBlue[2];
+	static void scalar(const unsigned char* rgb, unsigned char* out, size_t pixelCount)
+	{
+		rgbToGrayScalar(rgb, out, pixelCount);
+	}
+};
+const short ReductionWeights<false>::redGreen[2] = { (short)grayWeightR, 32767 };
+const short ReductionWeights<false>::greenBlue[2] = { (short)(grayWeightG - 32767), (short)grayWeightB };
+
+// (red + green + blue) / 3 is equal to ((red + green + blue) * 21846) >> 16 for every sum up to 765
+template <>
+struct ReductionWeights<true>
+{
+	static const short redGreen[2];
+	static const short greenBlue[2];
+	static void scalar(const unsigned char* rgb, unsigned char* out, size_t pixelCount)
+	{
+		rgbToAverageScalar(rgb, out, pixelCount);
+	}
+};
+const short ReductionWeights<true>::redGreen[2] = { 21846, 21846 };
+const short ReductionWeights<true>::greenBlue[2] = { 0, 21846 };
+
+// The pair of 16-bit weights as one 32-bit value, which is repeated in every 32-bit part of a register
+static inline int packWeights(const short* weights)
+{
+	return (int)((unsigned)(unsigned short)weights[0] | ((unsigned)(unsigned short)weights[1] << 16));
+}
+
+// Reduces four RGB pixels, stored in the lower 12 bytes of the register, to four 32-bit values.
+TARGET_SSE41 static inline __m128i reduce4(__m128i pixels, __m128i redGreenWeights, __m128i greenBlueWeights)
+{
+	const __m128i toRedGreen = _mm_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+	const __m128i toGreenBlue = _mm_setr_epi8(1, -1, 2, -1, 4, -1, 5, -1, 7, -1, 8, -1, 10, -1, 11, -1);
+	const __m128i sum = _mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(pixels, toRedGreen), redGreenWeights),
+		_mm_madd_epi16(_mm_shuffle_epi8(pixels, toGreenBlue), greenBlueWeights));
+	return _mm_srli_epi32(sum, 16);
+}
+
+// 16 pixels (48 bytes) at a time. The four groups of four pixels are cut out of three 16-byte loads.
+template <bool Average>
+TARGET_SSE41 static void reduceRGBSSE41(const unsigned char* rgb, unsigned char* out, size_t pixelCount)
+{
+	const __m128i redGreenWeights = _mm_set1_epi32(packWeights(ReductionWeights<Average>::redGreen));
+	const __m128i greenBlueWeights = _mm_set1_epi32(packWeights(ReductionWeights<Average>::greenBlue));
+	size_t i = 0;
+	for (; i + 16 <= pixelCount; i += 16, rgb += 48)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)rgb);
+		const __m128i b = _mm_loadu_si128((const __m128i*)(rgb + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i*)(rgb + 32));
+		const __m128i r0 = reduce4(a, redGreenWeights, greenBlueWeights);
+		const __m128i r1 = reduce4(_mm_alignr_epi8(b, a, 12), redGreenWeights, greenBlueWeights);
+		const __m128i r2 = reduce4(_mm_alignr_epi8(c, b, 8), redGreenWeights, greenBlueWeights);
+		const __m128i r3 = reduce4(_mm_srli_si128(c, 4), redGreenWeights, greenBlueWeights);
+		const __m128i packed = _mm_packus_epi16(_mm_packus_epi32(r0, r1), _mm_packus_epi32(r2, r3));
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+	ReductionWeights<Average>::scalar(rgb, out + i, pixelCount - i);
+}
+
+// 32 pixels (96 bytes) at a time. Register m holds the groups m (lower half) and 4 + m (upper half), because the
+// packing instructions work inside each half, and this way the results come out in the right order.
+template <bool Average>
+TARGET_AVX2 static void reduceRGBAVX2(const unsigned char* rgb, unsigned char* out, size_t pixelCount)
+{
+	const __m256i toRedGreen = _mm256_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1,
+		0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1);
+	const __m256i toGreenBlue = _mm256_setr_epi8(1, -1, 2, -1, 4, -1, 5, -1, 7, -1, 8, -1, 10, -1, 11, -1,
+		1, -1, 2, -1, 4, -1, 5, -1, 7, -1, 8, -1, 10, -1, 11, -1);
+	const __m256i redGreenWeights = _mm256_set1_epi32(packWeights(ReductionWeights<Average>::redGreen));
+	const __m256i greenBlueWeights = _mm256_set1_epi32(packWeights(ReductionWeights<Average>::greenBlue));
+	size_t i = 0;
+	for (; i + 32 <= pixelCount; i += 32, rgb += 96)
+	{
+		__m256i reduced[4];
+		for (int m = 0; m < 4; m++)
+		{
+			// Group g starts at byte 12 * g. The last group is loaded from 4 bytes earlier and shifted,
+			// so that nothing after the 96 bytes is read.
+			const __m128i low = _mm_loadu_si128((const __m128i*)(rgb + 12 * m));
+			const __m128i high = m < 3 ? _mm_loadu_si128((const __m128i*)(rgb + 12 * (4 + m)))
+				: _mm_srli_si128(_mm_loadu_si128((const __m128i*)(rgb + 80)), 4);
+			const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+			const __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(_mm256_shuffle_epi8(pixels, toRedGreen), redGreenWeights),
+				_mm256_madd_epi16(_mm256_shuffle_epi8(pixels, toGreenBlue), greenBlueWeights));
+			reduced[m] = _mm256_srli_epi32(sum, 16);
+		}
+		const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(reduced[0], reduced[1]), _mm256_packus_epi32(reduced[2], reduced[3]));
+		_mm256_storeu_si256((__m256i*)(out + i), packed);
+	}
+	reduceRGBSSE41<Average>(rgb, out + i, pixelCount - i);
+}
+
+// 64 pixels (192 bytes) at a time, with the same arrangement as AVX2: register m holds the groups m, 4 + m, 8 + m and 12 + m.
+template <bool Average>
+TARGET_AVX512 static void reduceRGBAVX512(const unsigned char* rgb, unsigned char* out, size_t pixelCount)
+{
+	// The same shuffles as for SSE4.1 (0, -1, 1, -1, 3, -1, ... and 1, -1, 2, -1, 4, -1, ...) in every quarter
+	const __m512i toRedGreen = _mm512_setr4_epi32((int)0xFF01FF00, (int)0xFF04FF03, (int)0xFF07FF06, (int)0xFF0AFF09);
+	const __m512i toGreenBlue = _mm512_setr4_epi32((int)0xFF02FF01, (int)0xFF05FF04, (int)0xFF08FF07, (int)0xFF0BFF0A);
+	const __m512i redGreenWeights = _mm512_set1_epi32(packWeights(ReductionWeights<Average>::redGreen));
+	const __m512i greenBlueWeights = _mm512_set1_epi32(packWeights(ReductionWeights<Average>::greenBlue));
+	size_t i = 0;
+	for (; i + 64 <= pixelCount; i += 64, rgb += 192)
+	{
+		__m512i reduced[4];
+		for (int m = 0; m < 4; m++)
+		{
+			__m512i pixels = _mm512_zextsi128_si512(_mm_loadu_si128((const __m128i*)(rgb + 12 * m)));
+			pixels = _mm512_inserti32x4(pixels, _mm_loadu_si128((const __m128i*)(rgb + 12 * (4 + m))), 1);
+			pixels = _mm512_inserti32x4(pixels, _mm_loadu_si128((const __m128i*)(rgb + 12 * (8 + m))), 2);
+			const __m128i last = m < 3 ? _mm_loadu_si128((const __m128i*)(rgb + 12 * (12 + m)))
+				: _mm_srli_si128(_mm_loadu_si128((const __m128i*)(rgb + 176)), 4);
+			pixels = _mm512_inserti32x4(pixels, last, 3);
+			const __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(_mm512_shuffle_epi8(pixels, toRedGreen), redGreenWeights),
+				_mm512_madd_epi16(_mm512_shuffle_epi8(pixels, toGreenBlue), greenBlueWeights));
+			reduced[m] = _mm512_srli_epi32(sum, 16);
+		}
+		const __m512i packed = _mm512_packus_epi16(_mm512_packus_epi32(reduced[0], reduced[1]), _mm512_packus_epi32(reduced[2], reduced[3]));
+		_mm512_storeu_si512((void*)(out + i), packed);
+	}
+	reduceRGBAVX2<Average>(rgb, out + i, pixelCount - i);
+}
+
+// The reductions of 16-bit values cannot use the multiply-add instruction, because the values do not fit into
+// its signed 16-bit multipliers. Every value is moved into a 32-bit lane of its own instead: the 12 values of four
+// pixels are loaded as two overlapping halves (values 0-7 and 4-11), and one shuffle of each half gathers the red,
+// green and blue values. The weighted sum of the grayscale formula fits into 32 bits (see toGrayValue), and the
+// sum of the average is divided by 3 by multiplying it by 0xAAAAAAAB and keeping bits 33 and up of the 64-bit
+// product, which is exact for every 32-bit number.
+alignas(16) static const signed char redLow[16] = { 0, 1, -1, -1, 6, 7, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1 };
+alignas(16) static const signed char redHigh[16] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1 };
+alignas(16) static const signed char greenLow[16] = { 2, 3, -1, -1, 8, 9, -1, -1, 14, 15, -1, -1, -1, -1, -1, -1 };
+alignas(16) static const signed char greenHigh[16] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 13, -1, -1 };
+alignas(16) static const signed char blueLow[16] = { 4, 5, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+alignas(16) static const signed char blueHigh[16] = { -1, -1, -1, -1, -1, -1, -1, -1, 8, 9, -1, -1, 14, 15, -1, -1 };
+
+template <bool Average>
+static void reduceRGBScalar(const unsigned short* rgb, unsigned short* out, size_t pixelCount)
+{
+	if constexpr (Average)
+	{
+		rgbToAverageScalar(rgb, out, pixelCount);
+	}
+	else
+	{
+		rgbToGrayScalar(rgb, out, pixelCount);
+	}
+}
+
+static inline __m128i loadShuffle(const signed char* bytes)
+{
+	return _mm_load_si128((const __m128i*)bytes);
+}
+
+// Reduces the four pixels of every 128-bit lane to four 32-bit values
+template <bool Average>
+TARGET_SSE41 static inline __m128i reduce4(__m128i low, __m128i high)
+{
+	const __m128i red = _mm_or_si128(_mm_shuffle_epi8(low, loadShuffle(redLow)), _mm_shuffle_epi8(high, loadShuffle(redHigh)));
+	const __m128i green = _mm_or_si128(_mm_shuffle_epi8(low, loadShuffle(greenLow)), _mm_shuffle_epi8(high, loadShuffle(greenHigh)));
+	const __m128i blue = _mm_or_si128(_mm_shuffle_epi8(low, loadShuffle(blueLow)), _mm_shuffle_epi8(high, loadShuffle(blueHigh)));
+	if constexpr (Average)
+	{
+		const __m128i sum = _mm_add_epi32(_mm_add_epi32(red, green), blue);
+		const __m128i magic = _mm_set1_epi32((int)0xAAAAAAAB);
+		const __m128i even = _mm_srli_epi64(_mm_mul_epu32(sum, magic), 33);
+		const __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), magic), 33);
+		return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+	}
+	else
+	{
+		const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(red, _mm_set1_epi32((int)grayWeightR)),
+			_mm_mullo_epi32(green, _mm_set1_epi32((int)grayWeightG))), _mm_mullo_epi32(blue, _mm_set1_epi32((int)grayWeightB)));
+		return _mm_srli_epi32(sum, 16);
+	}
+}
+
+template <bool Average>
+TARGET_AVX2 static inline __m256i reduce4(__m256i low, __m256i high)
+{
+	const __m256i red = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_broadcastsi128_si256(loadShuffle(redLow))),
+		_mm256_shuffle_epi8(high, _mm256_broadcastsi128_si256(loadShuffle(redHigh))));
+	const __m256i green = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_broadcastsi128_si256(loadShuffle(greenLow))),
+		_mm256_shuffle_epi8(high, _mm256_broadcastsi128_si256(loadShuffle(greenHigh))));
+	const __m256i blue = _mm256_or_si256(_mm256_shuffle_epi8(low, _mm256_broadcastsi128_si256(loadShuffle(blueLow))),
+		_mm256_shuffle_epi8(high, _mm256_broadcastsi128_si256(loadShuffle(blueHigh))));
+	if constexpr (Average)
+	{
+		const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(red, green), blue);
+		const __m256i magic = _mm256_set1_epi32((int)0xAAAAAAAB);
+		const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(sum, magic), 33);
+		const __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(sum, 32), magic), 33);
+		return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+	}
+	else
+	{
+		const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(red, _mm256_set1_epi32((int)grayWeightR)),
+			_mm256_mullo_epi32(green, _mm256_set1_epi32((int)grayWeightG))), _mm256_mullo_epi32(blue, _mm256_set1_epi32((int)grayWeightB)));
+		return _mm256_srli_epi32(sum, 16);
+	}
+}
+
+template <bool Average>
+TARGET_AVX512 static inline __m512i reduce4(__m512i low, __m512i high)
+{
+	const __m512i red = _mm512_or_si512(_mm512_shuffle_epi8(low, _mm512_broadcast_i32x4(loadShuffle(redLow))),
+		_mm512_shuffle_epi8(high, _mm512_broadcast_i32x4(loadShuffle(redHigh))));
+	const __m512i green = _mm512_or_si512(_mm512_shuffle_epi8(low, _mm512_broadcast_i32x4(loadShuffle(greenLow))),
+		_mm512_shuffle_epi8(high, _mm512_broadcast_i32x4(loadShuffle(greenHigh))));
+	const __m512i blue = _mm512_or_si512(_mm512_shuffle_epi8(low, _mm512_broadcast_i32x4(loadShuffle(blueLow))),
+		_mm512_shuffle_epi8(high, _mm512_broadcast_i32x4(loadShuffle(blueHigh))));
+	if constexpr (Average)
+	{
+		const __m512i sum = _mm512_add_epi32(_mm512_add_epi32(red, green), blue);
+		const __m512i magic = _mm512_set1_epi32((int)0xAAAAAAAB);
+		const __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(sum, magic), 33);
+		const __m512i odd = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(sum, 32), magic), 33);
+		return _mm512_or_si512(even, _mm512_slli_epi64(odd, 32));
+	}
+	else
+	{
+		const __m512i sum = _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(red, _mm512_set1_epi32((int)grayWeightR)),
+			_mm512_mullo_epi32(green, _mm512_set1_epi32((int)grayWeightG))), _mm512_mullo_epi32(blue, _mm512_set1_epi32((int)grayWeightB)));
+		return _mm512_srli_epi32(sum, 16);
+	}
+}
+
+// 8 pixels (48 bytes) at a time, in two groups of four pixels that start 12 values apart
+template <bool Average>
+TARGET_SSE41 static void reduceRGBSSE41(const unsigned short* rgb, unsigned short* out, size_t pixelCount)
+{
+	size_t i = 0;
+	for (; i + 8 <= pixelCount; i += 8, rgb += 24)
+	{
+		__m128i reduced[2];
+		for (int g = 0; g < 2; g++)
+		{
+			reduced[g] = reduce4<Average>(_mm_loadu_si128((const __m128i*)(rgb + 12 * g)), _mm_loadu_si128((const __m128i*)(rgb + 12 * g + 4)));
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(reduced[0], reduced[1]));
+	}
+	reduceRGBScalar<Average>(rgb, out + i, pixelCount - i);
+}
+
+// 16 pixels (96 bytes) at a time. Register m holds the groups m and 2 + m, so that the packing, which works inside
+// each 128-bit lane, puts the results in the right order.
+template <bool Average>
+TARGET_AVX2 static void reduceRGBAVX2(const unsigned short* rgb, unsigned short* out, size_t pixelCount)
+{
+	size_t i = 0;
+	for (; i + 16 <= pixelCount; i += 16, rgb += 48)
+	{
+		__m256i reduced[2];
+		for (int m = 0; m < 2; m++)
+		{
+			const __m256i low = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(rgb + 12 * m))),
+				_mm_loadu_si128((const __m128i*)(rgb + 12 * (2 + m))), 1);
+			const __m256i high = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(rgb + 12 * m + 4))),
+				_mm_loadu_si128((const __m128i*)(rgb + 12 * (2 + m) + 4)), 1);
+			reduced[m] = reduce4<Average>(low, high);
+		}
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi32(reduced[0], reduced[1]));
+	}
+	reduceRGBSSE41<Average>(rgb, out + i, pixelCount - i);
+}
+
+// 32 pixels (192 bytes) at a time. Register m holds the groups m, 2 + m, 4 + m and 6 + m.
+template <bool Average>
+TARGET_AVX512 static void reduceRGBAVX512(const unsigned short* rgb, unsigned short* out, size_t pixelCount)
+{
+	size_t i = 0;
+	for (; i + 32 <= pixelCount; i += 32, rgb += 96)
+	{
+		__m512i reduced[2];
+		for (int m = 0; m < 2; m++)
+		{
+			// The lane of an insertion must be a constant
+			const unsigned short* groups = rgb + 12 * m;
+			__m512i low = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)groups));
+			low = _mm512_inserti32x4(low, _mm_loadu_si128((const __m128i*)(groups + 24)), 1);
+			low = _mm512_inserti32x4(low, _mm_loadu_si128((const __m128i*)(groups + 48)), 2);
+			low = _mm512_inserti32x4(low, _mm_loadu_si128((const __m128i*)(groups + 72)), 3);
+			__m512i high = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(groups + 4)));
+			high = _mm512_inserti32x4(high, _mm_loadu_si128((const __m128i*)(groups + 28)), 1);
+			high = _mm512_inserti32x4(high, _mm_loadu_si128((const __m128i*)(groups + 52)), 2);
+			high = _mm512_inserti32x4(high, _mm_loadu_si128((const __m128i*)(groups + 76)), 3);
+			reduced[m] = reduce4<Average>(low, high);
+		}
+		_mm512_storeu_si512((void*)(out + i), _mm512_packus_epi32(reduced[0], reduced[1]));
+	}
+	reduceRGBAVX2<Average>(rgb, out + i, pixelCount - i);
+}
+
+// Every 16 bytes of gray values are spread over 48 bytes with three shuffles: 16 8-bit values or 8 16-bit values,
+// which are moved two bytes at a time.
+template <typename Sample>
+struct GrayExpansion
+{
+	alignas(16) static const signed char first[16];
+	alignas(16) static const signed char second[16];
+	alignas(16) static const signed char third[16];
+};
+
+template <>
+const signed char GrayExpansion<unsigned char>::first[16] = { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5 };
+template <>
+const signed char GrayExpansion<unsigned char>::second[16] = { 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10 };
+template <>
+const signed char GrayExpansion<unsigned char>::third[16] = { 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15 };
+
+template <>
+const signed char GrayExpansion<unsigned short>::first[16] = { 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 4, 5, 4, 5 };
+template <>
+const signed char GrayExpansion<unsigned short>::second[16] = { 4, 5, 6, 7, 6, 7, 6, 7, 8, 9, 8, 9, 8, 9, 10, 11 };
+template <>
+const signed char GrayExpansion<unsigned short>::third[16] = { 10, 11, 10, 11, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15 };
+
+template <typename Sample>
+TARGET_SSE41 static void grayToRGBSSE41(const Sample* gray, Sample* rgb, size_t pixelCount)
+{
+	const size_t step = 16 / sizeof(Sample); // The values in 16 bytes
+	const __m128i first = loadShuffle(GrayExpansion<Sample>::first);
+	const __m128i second = loadShuffle(GrayExpansion<Sample>::second);
+	const __m128i third = loadShuffle(GrayExpansion<Sample>::third);
+	size_t i = 0;
+	for (; i + step <= pixelCount; i += step, rgb += 3 * step)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(gray + i));
+		_mm_storeu_si128((__m128i*)rgb, _mm_shuffle_epi8(values, first));
+		_mm_storeu_si128((__m128i*)(rgb + step), _mm_shuffle_epi8(values, second));
+		_mm_storeu_si128((__m128i*)(rgb + 2 * step), _mm_shuffle_epi8(values, third));
+	}
+	grayToRGBScalar(gray + i, rgb, pixelCount - i);
+}
+
+// The shuffles only move bytes inside 128-bit lanes, so the 16-byte chunks of the gray values are first copied
+// into the lanes whose output they belong to. Each 48 bytes of output come from one chunk.
+template <typename Sample>
+TARGET_AVX2 static void grayToRGBAVX2(const Sample* gray, Sample* rgb, size_t pixelCount)
+{
+	const size_t step = 16 / sizeof(Sample);
+	const __m128i first = loadShuffle(GrayExpansion<Sample>::first);
+	const __m128i second = loadShuffle(GrayExpansion<Sample>::second);
+	const __m128i third = loadShuffle(GrayExpansion<Sample>::third);
+	const __m256i firstSecond = _mm256_setr_m128i(first, second);
+	const __m256i thirdFirst = _mm256_setr_m128i(third, first);
+	const __m256i secondThird = _mm256_setr_m128i(second, third);
+	size_t i = 0;
+	for (; i + 2 * step <= pixelCount; i += 2 * step, rgb += 6 * step)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(gray + i));
+		const __m256i low = _mm256_permute2x128_si256(values, values, 0x00);
+		const __m256i high = _mm256_permute2x128_si256(values, values, 0x11);
+		_mm256_storeu_si256((__m256i*)rgb, _mm256_shuffle_epi8(low, firstSecond));
+		_mm256_storeu_si256((__m256i*)(rgb + 2 * step), _mm256_shuffle_epi8(values, thirdFirst));
+		_mm256_storeu_si256((__m256i*)(rgb + 4 * step), _mm256_shuffle_epi8(high, secondThird));
+	}
+	grayToRGBSSE41(gray + i, rgb, pixelCount - i);
+}
+
+// The same with four chunks, which are copied to the lanes 0, 0, 0, 1 / 1, 1, 2, 2 / 2, 3, 3, 3 of the three outputs
+template <typename Sample>
+TARGET_AVX512 static void grayToRGBAVX512(const Sample* gray, Sample* rgb, size_t pixelCount)
+{
+	const size_t step = 16 / sizeof(Sample);
+	const __m512i first = _mm512_broadcast_i32x4(loadShuffle(GrayExpansion<Sample>::first));
+	const __m512i second = _mm512_broadcast_i32x4(loadShuffle(GrayExpansion<Sample>::second));
+	const __m512i third = _mm512_broadcast_i32x4(loadShuffle(GrayExpansion<Sample>::third));
+	// Lane k of each pattern is the shuffle of output 4 * n + k, which is first, second or third in turn
+	const __m512i pattern0 = _mm512_mask_blend_epi64(0x30, _mm512_mask_blend_epi64(0x0C, first, second), third);
+	const __m512i pattern1 = _mm512_mask_blend_epi64(0x30, _mm512_mask_blend_epi64(0x0C, second, third), first);
+	const __m512i pattern2 = _mm512_mask_blend_epi64(0x30, _mm512_mask_blend_epi64(0x0C, third, first), second);
+	size_t i = 0;
+	for (; i + 4 * step <= pixelCount; i += 4 * step, rgb += 12 * step)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(gray + i));
+		_mm512_storeu_si512((void*)rgb, _mm512_shuffle_epi8(_mm512_shuffle_i32x4(values, values, 0x40), pattern0));
+		_mm512_storeu_si512((void*)(rgb + 4 * step), _mm512_shuffle_epi8(_mm512_shuffle_i32x4(values, values, 0xA5), pattern1));
+		_mm512_storeu_si512((void*)(rgb + 8 * step), _mm512_shuffle_epi8(_mm512_shuffle_i32x4(values, values, 0xFE), pattern2));
+	}
+	grayToRGBAVX2(gray + i, rgb, pixelCount - i);
+}
+
+// Negation is a subtraction from a vector filled with the maximum value. Thresholding compares the values with
+// the middle (an unsigned comparison a >= b is the same as max(a, b) == a) and keeps the maximum value where it holds.
+static void negateSSE2(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m128i max = _mm_set1_epi8((char)maxValue);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(samples + i));
+		_mm_storeu_si128((__m128i*)(samples + i), _mm_sub_epi8(max, values));
+	}
+	negateScalar(samples + i, count - i, maxValue);
+}
+
+static void thresholdSSE2(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m128i max = _mm_set1_epi8((char)maxValue);
+	const __m128i middle = _mm_set1_epi8((char)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(samples + i));
+		const __m128i aboveMiddle = _mm_cmpeq_epi8(_mm_max_epu8(values, middle), values);
+		_mm_storeu_si128((__m128i*)(samples + i), _mm_and_si128(aboveMiddle, max));
+	}
+	thresholdScalar(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX2 static void negateAVX2(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m256i max = _mm256_set1_epi8((char)maxValue);
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(samples + i));
+		_mm256_storeu_si256((__m256i*)(samples + i), _mm256_sub_epi8(max, values));
+	}
+	negateSSE2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX2 static void thresholdAVX2(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m256i max = _mm256_set1_epi8((char)maxValue);
+	const __m256i middle = _mm256_set1_epi8((char)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(samples + i));
+		const __m256i aboveMiddle = _mm256_cmpeq_epi8(_mm256_max_epu8(values, middle), values);
+		_mm256_storeu_si256((__m256i*)(samples + i), _mm256_and_si256(aboveMiddle, max));
+	}
+	thresholdSSE2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX512 static void negateAVX512(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m512i max = _mm512_set1_epi8((char)maxValue);
+	size_t i = 0;
+	for (; i + 64 <= count; i += 64)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(samples + i));
+		_mm512_storeu_si512((void*)(samples + i), _mm512_sub_epi8(max, values));
+	}
+	negateAVX2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX512 static void thresholdAVX512(unsigned char* samples, size_t count, unsigned char maxValue)
+{
+	const __m512i max = _mm512_set1_epi8((char)maxValue);
+	const __m512i middle = _mm512_set1_epi8((char)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 64 <= count; i += 64)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(samples + i));
+		const __mmask64 aboveMiddle = _mm512_cmpge_epu8_mask(values, middle);
+		_mm512_storeu_si512((void*)(samples + i), _mm512_maskz_mov_epi8(aboveMiddle, max));
+	}
+	thresholdAVX2(samples + i, count - i, maxValue);
+}
+
+// The 16-bit versions process half as many values per instruction. SSE2 has no unsigned 16-bit maximum, so a value
+// is at least the middle when the saturated subtraction (middle - value) gives 0.
+static void negateSSE2(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m128i max = _mm_set1_epi16((short)maxValue);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(samples + i));
+		_mm_storeu_si128((__m128i*)(samples + i), _mm_sub_epi16(max, values));
+	}
+	negateScalar(samples + i, count - i, maxValue);
+}
+
+static void thresholdSSE2(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m128i max = _mm_set1_epi16((short)maxValue);
+	const __m128i middle = _mm_set1_epi16((short)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(samples + i));
+		const __m128i aboveMiddle = _mm_cmpeq_epi16(_mm_subs_epu16(middle, values), _mm_setzero_si128());
+		_mm_storeu_si128((__m128i*)(samples + i), _mm_and_si128(aboveMiddle, max));
+	}
+	thresholdScalar(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX2 static void negateAVX2(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m256i max = _mm256_set1_epi16((short)maxValue);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(samples + i));
+		_mm256_storeu_si256((__m256i*)(samples + i), _mm256_sub_epi16(max, values));
+	}
+	negateSSE2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX2 static void thresholdAVX2(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m256i max = _mm256_set1_epi16((short)maxValue);
+	const __m256i middle = _mm256_set1_epi16((short)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(samples + i));
+		const __m256i aboveMiddle = _mm256_cmpeq_epi16(_mm256_max_epu16(values, middle), values);
+		_mm256_storeu_si256((__m256i*)(samples + i), _mm256_and_si256(aboveMiddle, max));
+	}
+	thresholdSSE2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX512 static void negateAVX512(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m512i max = _mm512_set1_epi16((short)maxValue);
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(samples + i));
+		_mm512_storeu_si512((void*)(samples + i), _mm512_sub_epi16(max, values));
+	}
+	negateAVX2(samples + i, count - i, maxValue);
+}
+
+TARGET_AVX512 static void thresholdAVX512(unsigned short* samples, size_t count, unsigned short maxValue)
+{
+	const __m512i max = _mm512_set1_epi16((short)maxValue);
+	const __m512i middle = _mm512_set1_epi16((short)(maxValue / 2));
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(samples + i));
+		const __mmask32 aboveMiddle = _mm512_cmpge_epu16_mask(values, middle);
+		_mm512_storeu_si512((void*)(samples + i), _mm512_maskz_mov_epi16(aboveMiddle, max));
+	}
+	thresholdAVX2(samples + i, count - i, maxValue);
+}
+
+// The two bytes of every value are swapped by shifting them past each other
+static void convertBigEndianSSE2(unsigned short* samples, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i values = _mm_loadu_si128((const __m128i*)(samples + i));
+		_mm_storeu_si128((__m128i*)(samples + i), _mm_or_si128(_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8)));
+	}
+	convertBigEndianScalar(samples + i, count - i);
+}
+
+TARGET_AVX2 static void convertBigEndianAVX2(unsigned short* samples, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i values = _mm256_loadu_si256((const __m256i*)(samples + i));
+		_mm256_storeu_si256((__m256i*)(samples + i), _mm256_or_si256(_mm256_slli_epi16(values, 8), _mm256_srli_epi16(values, 8)));
+	}
+	convertBigEndianSSE2(samples + i, count - i);
+}
+
+TARGET_AVX512 static void convertBigEndianAVX512(unsigned short* samples, size_t count)
+{
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		const __m512i values = _mm512_loadu_si512((const void*)(samples + i));
+		_mm512_storeu_si512((void*)(samples + i), _mm512_or_si512(_mm512_slli_epi16(values, 8), _mm512_srli_epi16(values, 8)));
+	}
+	convertBigEndianAVX2(samples + i, count - i);
+}
+#endif
+
+template <typename Sample>
+void rgbToGray(const Sample* rgb, Sample* gray, size_t pixelCount)
+{
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		reduceRGBAVX512<false>(rgb, gray, pixelCount);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		reduceRGBAVX2<false>(rgb, gray, pixelCount);
+		return;
+	}
+	if (level >= sse41Level)
+	{
+		reduceRGBSSE41<false>(rgb, gray, pixelCount);
+		return;
+	}
+#endif
+	rgbToGrayScalar(rgb, gray, pixelCount);
+}
+
+template <typename Sample>
+void rgbToAverage(const Sample* rgb, Sample* average, size_t pixelCount)
+{
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		reduceRGBAVX512<true>(rgb, average, pixelCount);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		reduceRGBAVX2<true>(rgb, average, pixelCount);
+		return;
+	}
+	if (level >= sse41Level)
+	{
+		reduceRGBSSE41<true>(rgb, average, pixelCount);
+		return;
+	}
+#endif
+	rgbToAverageScalar(rgb, average, pixelCount);
+}
+
+template <typename Sample>
+void grayToRGB(const Sample* gray, Sample* rgb, size_t pixelCount)
+{
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		grayToRGBAVX512(gray, rgb, pixelCount);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		grayToRGBAVX2(gray, rgb, pixelCount);
+		return;
+	}
+	if (level >= sse41Level)
+	{
+		grayToRGBSSE41(gray, rgb, pixelCount);
+		return;
+	}
+#endif
+	grayToRGBScalar(gray, rgb, pixelCount);
+}
+
+template <typename Sample>
+void negate(Sample* samples, size_t count, unsigned short maxValue)
+{
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		negateAVX512(samples, count, (Sample)maxValue);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		negateAVX2(samples, count, (Sample)maxValue);
+		return;
+	}
+	if (level >= sse2Level)
+	{
+		negateSSE2(samples, count, (Sample)maxValue);
+		return;
+	}
+#endif
+	negateScalar(samples, count, (Sample)maxValue);
+}
+
+template <typename Sample>
+void threshold(Sample* samples, size_t count, unsigned short maxValue)
+{
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		thresholdAVX512(samples, count, (Sample)maxValue);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		thresholdAVX2(samples, count, (Sample)maxValue);
+		return;
+	}
+	if (level >= sse2Level)
+	{
+		thresholdSSE2(samples, count, (Sample)maxValue);
+		return;
+	}
+#endif
+	thresholdScalar(samples, count, (Sample)maxValue);
+}
+
+template void rgbToGray(const unsigned char*, unsigned char*, size_t);
+template void rgbToGray(const unsigned short*, unsigned short*, size_t);
+template void rgbToAverage(const unsigned char*, unsigned char*, size_t);
+template void rgbToAverage(const unsigned short*, unsigned short*, size_t);
+template void grayToRGB(const unsigned char*, unsigned char*, size_t);
+template void grayToRGB(const unsigned short*, unsigned short*, size_t);
+template void negate(unsigned char*, size_t, unsigned short);
+template void negate(unsigned short*, size_t, unsigned short);
+template void threshold(unsigned char*, size_t, unsigned short);
+template void threshold(unsigned short*, size_t, unsigned short);
+
+void convertBigEndian(unsigned short* samples, size_t count)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	// The values are already in the order of the file
+#else
+#ifdef NETPBM_X86
+	const KernelLevel level = getKernelLevel();
+	if (level >= avx512Level)
+	{
+		convertBigEndianAVX512(samples, count);
+		return;
+	}
+	if (level >= avx2Level)
+	{
+		convertBigEndianAVX2(samples, count);
+		return;
+	}
+	if (level >= sse2Level)
+	{
+		convertBigEndianSSE2(samples, count);
+		return;
+	}
+#endif
+	convertBigEndianScalar(samples, count);
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+/* Vectorised versions of the most common point operations. Every function has a plain C++ version and
+versions for SSE4.1, AVX2 and AVX-512, and the best one supported by the processor is chosen at runtime
+(see Cpu.h). All versions use only integer arithmetic, so they give exactly the same results. */
+
+// The values of an image whose maximum value is larger than 255 do not fit into a byte, so they are stored as
+// 16-bit numbers (unsigned short), in the byte order of the processor. Every kernel is a template of the type of
+// the values, and the 8-bit and 16-bit versions are separate, so each of them uses the full width of the vector
+// registers for its own type. Both versions are defined in Kernels.cpp.
+inline size_t getSampleSize(unsigned maxValue)
+{
+	return maxValue > 255 ? 2 : 1;
+}
+
+// Converts pixelCount interleaved RGB pixels into gray values, one value per pixel, with the fixed-point
+// grayscale formula from PointOps.h. The source and the destination must not overlap.
+template <typename Sample>
+void rgbToGray(const Sample* rgb, Sample* gray, size_t pixelCount);
+
+// Replaces every RGB pixel by the average of its three values, one value per pixel.
+template <typename Sample>
+void rgbToAverage(const Sample* rgb, Sample* average, size_t pixelCount);
+
+// Writes every gray value three times, producing interleaved RGB pixels.
+template <typename Sample>
+void grayToRGB(const Sample* gray, Sample* rgb, size_t pixelCount);
+
+// Replaces every value by (maxValue - value). The values must not be larger than maxValue.
+template <typename Sample>
+void negate(Sample* samples, size_t count, unsigned short maxValue);
+
+// Replaces every value by maxValue if it is at least maxValue / 2, and by 0 otherwise.
+template <typename Sample>
+void threshold(Sample* samples, size_t count, unsigned short maxValue);
+
+// The raw formats store 16-bit values with the most significant byte first. This converts count values between
+// that order and the order of the processor, in place - the conversion is the same in both directions.
+void convertBigEndian(unsigned short* samples, size_t count);
@@ -0,0 +1,184 @@
+#include "MappedFile.h"
+#include <atomic>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	std::atomic<bool> mappingEnabled(true);
+}
+
+bool isMappingEnabled()
+{
+	return mappingEnabled.load();
+}
+
+void setMappingEnabled(bool enabled)
+{
+	mappingEnabled.store(enabled);
+}
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) { }
+
+bool MappedFile::openReadOnly(const std::string& filePath)
+{
+	close();
+	this->file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize;
+	if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	this->data = this->mapping == nullptr ? nullptr : (unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (this->data == nullptr)
+	{
+		close();
+		return false;
+	}
+	this->size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+bool MappedFile::create(const std::string& filePath, size_t size)
+{
+	close();
+	this->file = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (this->file == INVALID_HANDLE_VALUE || size == 0)
+	{
+		close();
+		return false;
+	}
+	// Creating the mapping with the final size also makes the file that long
+	this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, nullptr);
+	this->data = this->mapping == nullptr ? nullptr : (unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_WRITE, 0, 0, size);
+	if (this->data == nullptr)
+	{
+		close();
+		return false;
+	}
+	this->size = size;
+	return true;
+}
+
+bool MappedFile::close()
+{
+	bool succeeded = true;
+	if (this->data != nullptr)
+	{
+		succeeded = UnmapViewOfFile(this->data) != 0;
+	}
+	if (this->mapping != nullptr)
+	{
+		CloseHandle(this->mapping);
+	}
+	if (this->file != INVALID_HANDLE_VALUE)
+	{
+		succeeded = CloseHandle(this->file) != 0 && succeeded;
+	}
+	this->data = nullptr;
+	this->size = 0;
+	this->mapping = nullptr;
+	this->file = INVALID_HANDLE_VALUE;
+	return succeeded;
+}
+
+#else
+
+MappedFile::MappedFile() : data(nullptr), size(0), descriptor(-1) { }
+
+bool MappedFile::openReadOnly(const std::string& filePath)
+{
+	close();
+	this->descriptor = ::open(filePath.c_str(), O_RDONLY);
+	struct stat status;
+	if (this->descriptor < 0 || fstat(this->descriptor, &status) != 0 || status.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	// The mapping is private, so even if the pages were written to, the file would not change
+	void* address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, this->descriptor, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	this->data = (unsigned char*)address;
+	this->size = (size_t)status.st_size;
+	return true;
+}
+
+bool MappedFile::create(const std::string& filePath, size_t size)
+{
+	close();
+	this->descriptor = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (this->descriptor < 0 || size == 0 || ftruncate(this->descriptor, (off_t)size) != 0)
+	{
+		close();
+		return false;
+	}
+	void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->descriptor, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	this->data = (unsigned char*)address;
+	this->size = size;
+	return true;
+}
+
+bool MappedFile::close()
+{
+	bool succeeded = true;
+	if (this->data != nullptr)
+	{
+		succeeded = munmap(this->data, this->size) == 0;
+	}
+	if (this->descriptor >= 0)
+	{
+		succeeded = ::close(this->descriptor) == 0 && succeeded;
+	}
+	this->data = nullptr;
+	this->size = 0;
+	this->descriptor = -1;
+	return succeeded;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::isOpen() const
+{
+	return this->data != nullptr;
+}
+
+const unsigned char* MappedFile::getData() const
+{
+	return this->data;
+}
+
+unsigned char* MappedFile::getData()
+{
+	return this->data;
+}
+
+size_t MappedFile::getSize() const
+{
+	return this->size;
+}
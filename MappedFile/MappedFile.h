@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/* A file mapped into memory. A file opened for reading is mapped privately and read-only, so its pixels can
+be used where they are without copying them into a buffer first; the pages are read from the disk only when
+they are touched. A file created for writing has its final size from the start, and whatever is written to
+the mapping ends up in the file. */
+
+class MappedFile
+{
+private:
+	unsigned char* data;
+	size_t size;
+#if defined(_WIN32)
+	void* file;    // The handles of the file and of the mapping object
+	void* mapping;
+#else
+	int descriptor;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool openReadOnly(const std::string& filePath);
+	bool create(const std::string& filePath, size_t size); // Creates (or truncates) the file and resizes it
+	bool close(); // Returns false if the data could not be written to the file
+	bool isOpen() const;
+
+	const unsigned char* getData() const;
+	unsigned char* getData(); // Only files created for writing can be written to
+	size_t getSize() const;
+};
+
+// Whether raw files are mapped instead of read, and saved through a mapping. It is enabled by default.
+bool isMappingEnabled();
+void setMappingEnabled(bool enabled);
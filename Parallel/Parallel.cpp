@@ -0,0 +1,174 @@
+#include "Parallel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// One million pixels is about 3 MB of RGB samples, which takes around a millisecond to process.
+// Below that, waking up the other threads is not worth it.
+static std::atomic<size_t> parallelThreshold(1 << 20);
+
+// The helper threads are started the first time they are needed.
+static std::mutex poolMutex;
+static std::unique_ptr<ThreadPool> pool;
+static unsigned poolWorkerCount = ThreadPool::getDefaultWorkerCount() - 1;
+
+// The target number of pixels in one stripe. Smaller stripes balance better, larger ones cost less to hand out.
+static const size_t stripePixels = 1 << 16;
+
+// The stripes that a thread has not processed yet. The owner takes them from the front,
+// the other threads steal from the back.
+struct StripeRange
+{
+	std::mutex mutex;
+	size_t begin = 0;
+	size_t end = 0;
+};
+
+// The shared state of one call of parallelFor. It is owned jointly by the calling thread and the helpers,
+// because a helper can start after the work is done and the calling thread has returned.
+struct ParallelJob
+{
+	std::function<void(size_t, size_t)> body;
+	size_t itemCount = 0;
+	size_t stripeItems = 0; // The number of items in one stripe
+	std::vector<StripeRange> ranges; // One range for every thread that takes part
+	std::atomic<unsigned> nextParticipant{ 1 }; // The calling thread is participant 0
+	std::atomic<size_t> remainingStripes{ 0 };
+	std::mutex doneMutex;
+	std::condition_variable done;
+
+	ParallelJob(size_t participantCount) : ranges(participantCount) { }
+
+	// Takes one stripe from the participant's own range, or steals half of the range of another one.
+	bool takeStripe(size_t participant, size_t& stripe)
+	{
+		StripeRange& own = this->ranges[participant];
+		{
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (own.begin < own.end)
+			{
+				stripe = own.begin++;
+				return true;
+			}
+		}
+		for (size_t i = 1; i < this->ranges.size(); i++)
+		{
+			StripeRange& victim = this->ranges[(participant + i) % this->ranges.size()];
+			size_t stolenBegin, stolenEnd;
+			{
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.begin >= victim.end)
+				{
+					continue;
+				}
+				stolenEnd = victim.end;
+				stolenBegin = victim.end - (victim.end - victim.begin + 1) / 2;
+				victim.end = stolenBegin;
+			}
+			// The first stolen stripe is processed at once and the rest go to the own range,
+			// where they can be stolen again.
+			std::lock_guard<std::mutex> lock(own.mutex);
+			own.begin = stolenBegin + 1;
+			own.end = stolenEnd;
+			stripe = stolenBegin;
+			return true;
+		}
+		return false;
+	}
+
+	void work(size_t participant)
+	{
+		size_t stripe;
+		while (takeStripe(participant, stripe))
+		{
+			const size_t begin = stripe * this->stripeItems;
+			const size_t end = std::min(begin + this->stripeItems, this->itemCount);
+			this->body(begin, end);
+			if (this->remainingStripes.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(this->doneMutex);
+				this->done.notify_all();
+			}
+		}
+	}
+};
+
+void parallelFor(size_t itemCount, size_t itemPixels, const std::function<void(size_t, size_t)>& body)
+{
+	if (itemCount == 0)
+	{
+		return;
+	}
+	const size_t totalPixels = itemCount * std::max<size_t>(itemPixels, 1);
+	const unsigned helperCount = getParallelWorkerCount();
+	if (totalPixels < getParallelThreshold() || helperCount == 0 || itemCount == 1)
+	{
+		body(0, itemCount);
+		return;
+	}
+
+	const size_t participantCount = (size_t)helperCount + 1;
+	std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>(participantCount);
+	job->body = body;
+	job->itemCount = itemCount;
+	job->stripeItems = std::max<size_t>(stripePixels / std::max<size_t>(itemPixels, 1), 1);
+	const size_t stripeCount = (itemCount + job->stripeItems - 1) / job->stripeItems;
+	job->remainingStripes = stripeCount;
+	for (size_t i = 0; i < participantCount; i++)
+	{
+		job->ranges[i].begin = stripeCount * i / participantCount;
+		job->ranges[i].end = stripeCount * (i + 1) / participantCount;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if (!pool)
+		{
+			pool.reset(new ThreadPool(poolWorkerCount));
+		}
+		const size_t helpersNeeded = std::min<size_t>(helperCount, stripeCount - 1);
+		for (size_t i = 0; i < helpersNeeded; i++)
+		{
+			pool->submit([job] {
+				const unsigned participant = job->nextParticipant++;
+				if (participant < job->ranges.size())
+				{
+					job->work(participant);
+				}
+			});
+		}
+	}
+
+	// The calling thread works too. It never waits for a helper that has not started, because the stripes
+	// of such a helper are stolen. It only waits for the stripes that are being processed at the moment.
+	job->work(0);
+	std::unique_lock<std::mutex> lock(job->doneMutex);
+	job->done.wait(lock, [&job] { return job->remainingStripes.load() == 0; });
+}
+
+size_t getParallelThreshold()
+{
+	return parallelThreshold.load(std::memory_order_relaxed);
+}
+
+void setParallelThreshold(size_t pixelCount)
+{
+	parallelThreshold.store(pixelCount, std::memory_order_relaxed);
+}
+
+unsigned getParallelWorkerCount()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return poolWorkerCount;
+}
+
+void setParallelWorkerCount(unsigned workerCount)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	if (workerCount != poolWorkerCount)
+	{
+		poolWorkerCount = workerCount;
+		pool.reset();
+	}
+}
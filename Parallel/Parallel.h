@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+/* A single very large image cannot benefit from executing the images of a session in parallel, so the
+operations of Image also split their own work into stripes (groups of rows or columns) that are processed
+by several threads. Every thread starts with an equal share of the stripes, and a thread that finishes its
+share steals half of the remaining stripes of another thread, so uneven stripes still keep all threads busy.
+Small images are processed by the calling thread alone, because starting the other threads would cost
+more than it saves. */
+
+// Calls body(begin, end) for disjoint ranges of items that together cover [0, itemCount). Every item stands
+// for itemPixels pixels of work. When the total number of pixels is below the threshold, body is called
+// once, by the calling thread, with the whole range. The calling thread always takes part in the work.
+void parallelFor(size_t itemCount, size_t itemPixels, const std::function<void(size_t, size_t)>& body);
+
+// The number of pixels below which an operation stays single-threaded
+size_t getParallelThreshold();
+void setParallelThreshold(size_t pixelCount);
+
+// The number of threads that help the calling thread. The default is one less than the number of
+// processor cores. It should be changed only while no image is being processed.
+unsigned getParallelWorkerCount();
+void setParallelWorkerCount(unsigned workerCount);
@@ -34,13 +34,13 @@ bool Pixel::operator!=(const Pixel& other)
 
 void Pixel::setMaxValue(const unsigned short& value)
 {
-	if (value <= 255 && value >= 1)
+	if (value >= 1)
 	{
 		this->maxValue = value;
 	}
 	else
 	{
-		std::cout << "A pixel's maximum value can range from 1 to 255\n";
+		std::cout << "A pixel's maximum value can range from 1 to 65535\n";
 	}
 }
 
@@ -62,22 +62,22 @@ void Pixel::setValues(const unsigned short& red, const unsigned short& green, co
 	}
 }
 
-short Pixel::getMaxValue() const
+unsigned short Pixel::getMaxValue() const
 {
 	return this->maxValue;
 }
 
-short Pixel::getRValue() const
+unsigned short Pixel::getRValue() const
 {
 	return this->red;
 }
 
-short Pixel::getGValue() const
+unsigned short Pixel::getGValue() const
 {
 	return this->green;
 }
 
-short Pixel::getBValue() const
+unsigned short Pixel::getBValue() const
 {
 	return this->blue;
 }
\ No newline at end of file
@@ -27,10 +27,10 @@ public:
 	bool operator!=(const Pixel&);
 
 	// Member functions for accessing the values of the pixel's member variables:
-	short getMaxValue() const;
-	short getRValue() const;
-	short getGValue() const;
-	short getBValue() const;
+	unsigned short getMaxValue() const;
+	unsigned short getRValue() const;
+	unsigned short getGValue() const;
+	unsigned short getBValue() const;
 private:
 	// Private member functions that ensure the validity of the data in the class:
 	void setMaxValue(const unsigned short&);
@@ -0,0 +1,191 @@
+#include "PointOps.h"
+#include "Kernels.h"
+#include <cstring>
+
+void PointOps::add(const PointOperation& operation)
+{
+	this->operations.push_back(operation);
+}
+
+void PointOps::add(const PointOps& chain)
+{
+	this->operations.insert(this->operations.end(), chain.operations.begin(), chain.operations.end());
+}
+
+bool PointOps::isEmpty() const
+{
+	return this->operations.empty();
+}
+
+void PointOps::clear()
+{
+	this->operations.clear();
+}
+
+PointOpsPass PointOps::compile(const unsigned short& maxValue, const bool& isBitmap, const unsigned short& channels) const
+{
+	PointOpsPass pass;
+	pass.reduction = noReduction;
+	pass.lutBefore.resize(maxValue + 1);
+	pass.lutAfter.resize(maxValue + 1);
+	for (unsigned value = 0; value <= maxValue; value++)
+	{
+		pass.lutBefore[value] = pass.lutAfter[value] = (unsigned short)value;
+	}
+
+	// Until the first reduction, the operations change the three values of a pixel separately, so they are
+	// composed into lutBefore. After the reduction the pixel is gray and they are composed into lutAfter.
+	// Gray images have one value per pixel, so there is never a reduction.
+	const bool isColor = channels == 3;
+	std::vector<unsigned short>* lut = &pass.lutBefore;
+	for (size_t i = 0; i < this->operations.size(); i++)
+	{
+		switch (this->operations[i])
+		{
+		case grayscaleOperation:
+			// A pixel that is already gray stays the same
+			if (isColor && pass.reduction == noReduction)
+			{
+				pass.reduction = weightedReduction;
+				lut = &pass.lutAfter;
+			}
+			break;
+		case monochromeOperation:
+			if (isBitmap)
+			{
+				break;
+			}
+			if (isColor && pass.reduction == noReduction)
+			{
+				pass.reduction = averageReduction;
+				lut = &pass.lutAfter;
+			}
+			// The (average) value is compared with the middle between black and white
+			for (unsigned value = 0; value <= maxValue; value++)
+			{
+				(*lut)[value] = (*lut)[value] >= maxValue / 2 ? maxValue : 0;
+			}
+			break;
+		case negativeOperation:
+			for (unsigned value = 0; value <= maxValue; value++)
+			{
+				(*lut)[value] = (unsigned short)(maxValue - (*lut)[value]);
+			}
+			break;
+		}
+	}
+
+	// For example, two negatives cancel each other out
+	pass.shapeBefore = getLutShape(pass.lutBefore, maxValue);
+	pass.shapeAfter = getLutShape(pass.lutAfter, maxValue);
+	pass.identity = pass.reduction == noReduction && pass.shapeBefore == identityLut;
+	return pass;
+}
+
+LutShape getLutShape(const std::vector<unsigned short>& lut, const unsigned short& maxValue)
+{
+	bool identity = true, negative = true, threshold = true;
+	for (unsigned value = 0; value <= maxValue; value++)
+	{
+		identity = identity && lut[value] == value;
+		negative = negative && lut[value] == maxValue - value;
+		threshold = threshold && lut[value] == (value >= maxValue / 2u ? maxValue : 0);
+	}
+	if (identity)
+	{
+		return identityLut;
+	}
+	if (negative)
+	{
+		return negativeLut;
+	}
+	return threshold ? thresholdLut : otherLut;
+}
+
+// Applies a lookup table to count values, using a vectorised kernel for the common shapes of tables.
+template <typename Sample>
+static void applyLut(Sample* samples, const size_t& count, const std::vector<unsigned short>& lut, const LutShape& shape, const unsigned short& maxValue)
+{
+	switch (shape)
+	{
+	case identityLut:
+		break;
+	case negativeLut:
+		negate(samples, count, maxValue);
+		break;
+	case thresholdLut:
+		threshold(samples, count, maxValue);
+		break;
+	default:
+		for (size_t i = 0; i < count; i++)
+		{
+			samples[i] = (Sample)lut[samples[i]];
+		}
+		break;
+	}
+}
+
+// Applies a compiled chain to rowCount rows of width pixels.
+template <typename Sample>
+void applyPointOpsPass(const PointOpsPass& pass, const Sample* src, Sample* dst, const size_t& rowCount,
+	const size_t& width, const unsigned short& maxValue, const unsigned short& channels)
+{
+	if (pass.reduction == noReduction)
+	{
+		if (dst != src)
+		{
+			std::memcpy(dst, src, rowCount * width * channels * sizeof(Sample));
+		}
+		if (!pass.identity)
+		{
+			applyLut(dst, rowCount * width * channels, pass.lutBefore, pass.shapeBefore, maxValue);
+		}
+		return;
+	}
+
+	// The pixels are reduced one row at a time into a small buffer, which stays in the cache,
+	// and the reduced values are then copied to the row of the gray result. A row of the result is never
+	// longer than the row of the source that it comes from, so the result can overwrite the source.
+	// The following formula for achieving the grayscale appearance of the image is taken from:
+	//https://learn.microsoft.com/en-us/previous-versions/bb332387(v=msdn.10)?redirectedfrom=MSDN#tbconimagecolorizer_grayscaleconversion
+	// The weights are fixed-point integers (see PointOps.h), so no floating-point arithmetic is needed.
+	// To convert the images to monochrome(composed of only black or white pixels), I find the average value
+	// of the colors that make up the pixel. Whether it is closer to white (the maximum value) 
+	// or black (value 0) is decided by lutAfter.
+	const bool simpleBefore = pass.shapeBefore == identityLut;
+	const unsigned short* lutBefore = pass.lutBefore.data();
+	std::vector<Sample> reduced(width);
+	for (size_t row = 0; row < rowCount; row++)
+	{
+		const Sample* pixel = src + row * width * 3;
+		if (simpleBefore && pass.reduction == weightedReduction)
+		{
+			rgbToGray(pixel, reduced.data(), width);
+		}
+		else if (simpleBefore)
+		{
+			rgbToAverage(pixel, reduced.data(), width);
+		}
+		else
+		{
+			for (size_t col = 0; col < width; col++, pixel += 3)
+			{
+				if (pass.reduction == weightedReduction)
+				{
+					reduced[col] = (Sample)toGrayValue(lutBefore[pixel[0]], lutBefore[pixel[1]], lutBefore[pixel[2]]);
+				}
+				else
+				{
+					reduced[col] = (Sample)((lutBefore[pixel[0]] + lutBefore[pixel[1]] + lutBefore[pixel[2]]) / 3);
+				}
+			}
+		}
+		applyLut(reduced.data(), width, pass.lutAfter, pass.shapeAfter, maxValue);
+		std::memcpy(dst + row * width, reduced.data(), width * sizeof(Sample));
+	}
+}
+
+template void applyPointOpsPass(const PointOpsPass&, const unsigned char*, unsigned char*, const size_t&,
+	const size_t&, const unsigned short&, const unsigned short&);
+template void applyPointOpsPass(const PointOpsPass&, const unsigned short*, unsigned short*, const size_t&,
+	const size_t&, const unsigned short&, const unsigned short&);
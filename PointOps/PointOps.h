@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/* Grayscale, monochrome and negative are point operations: the new value of a pixel depends only on
+its old value, not on its position or its neighbours. A chain of such operations can therefore be
+compiled into a few lookup tables and executed in a single pass over the image, with one read and one
+write per pixel, no matter how many operations the chain contains. */
+
+enum PointOperation
+{
+	grayscaleOperation,
+	monochromeOperation,
+	negativeOperation,
+};
+
+// The ways in which the three values of a color pixel can be combined into one gray value
+enum Reduction
+{
+	noReduction,       // The values of the pixel are processed separately
+	weightedReduction, // Grayscale: 0.299 * red + 0.587 * green + 0.114 * blue
+	averageReduction,  // Monochrome: the average of the three values
+};
+
+// Lookup tables of these shapes are applied with the vectorised kernels from Kernels.h instead of a table lookup.
+enum LutShape
+{
+	identityLut,  // Every value stays the same
+	negativeLut,  // Every value becomes maxValue - value
+	thresholdLut, // Every value becomes maxValue if it is at least maxValue / 2, and 0 otherwise
+	otherLut,
+};
+
+// The result of compiling a chain of point operations for a particular image. Every value of the image
+// is first looked up in lutBefore. If the chain contains a reduction, the three values of every pixel
+// are then combined into one, which is looked up in lutAfter. The result of a reduction is a gray image,
+// which has only one value per pixel. The tables have maxValue + 1 entries, which are 16-bit numbers,
+// because the values of images with a maximum value above 255 are (see getSampleSize in Kernels.h).
+struct PointOpsPass
+{
+	std::vector<unsigned short> lutBefore;
+	Reduction reduction;
+	std::vector<unsigned short> lutAfter;
+	bool identity; // True if the chain does not change the image at all
+	// The shapes of the tables, found once by compile, because the pass is applied to every stripe or row separately
+	LutShape shapeBefore;
+	LutShape shapeAfter;
+};
+
+class PointOps
+{
+private:
+	std::vector<PointOperation> operations; // The operations in the order in which they were added
+
+public:
+	void add(const PointOperation& operation);
+	void add(const PointOps& chain); // Appends all operations of another chain
+	bool isEmpty() const;
+	void clear();
+
+	// Compiles the chain for an image with the given maximum value and number of channels. Grayscale does nothing
+	// to gray images (one channel) and monochrome does nothing to .pbm images (isBitmap), just like the separate commands.
+	PointOpsPass compile(const unsigned short& maxValue, const bool& isBitmap, const unsigned short& channels) const;
+};
+
+LutShape getLutShape(const std::vector<unsigned short>& lut, const unsigned short& maxValue);
+
+// Applies a compiled chain to rowCount rows of width pixels with the given number of channels (interleaved),
+// which must be next to each other, and writes the result to dst. With a reduction the rows of dst have one
+// channel, otherwise they have the layout of src. dst can be the same as src. The values are bytes (unsigned char)
+// or 16-bit numbers (unsigned short), and both versions are defined in PointOps.cpp.
+template <typename Sample>
+void applyPointOpsPass(const PointOpsPass& pass, const Sample* src, Sample* dst, const size_t& rowCount,
+	const size_t& width, const unsigned short& maxValue, const unsigned short& channels);
+
+// The weights of the grayscale formula as fixed-point numbers with 16 fractional bits. They add up to exactly 65536,
+// so a pixel whose three values are equal keeps its value.
+const unsigned grayWeightR = 19595;
+const unsigned grayWeightG = 38470;
+const unsigned grayWeightB = 7471;
+
+// The sum fits into 32 bits even for 16-bit values, because the weights add up to 65536.
+inline unsigned toGrayValue(const unsigned& red, const unsigned& green, const unsigned& blue)
+{
+	return (grayWeightR * red + grayWeightG * green + grayWeightB * blue) >> 16;
+}
@@ -1,16 +1,22 @@
 #include "Session.h"
 #include <string>
+#include <algorithm>
+#include "ThreadPool.h"
 
 unsigned Session::idGenerator = 0;
 
-Session::Session() : valid(false), id(++idGenerator) { }
+static const size_t defaultCacheBudget = (size_t)256 << 20;
 
-Session::Session(std::vector<std::string> filePaths)
+Session::Session() : valid(false), id(++idGenerator), cache(std::make_shared<StateCache>(defaultCacheBudget)) { }
+
+Session::Session(std::vector<std::string> filePaths, bool streaming) : streaming(streaming), cache(std::make_shared<StateCache>(defaultCacheBudget))
 {
 	id = ++idGenerator;
 	for (size_t i = 0; i < filePaths.size(); i++)
 	{
-		Image img(filePaths[i]);
+		// Only the headers are read here. The pixels are read during the execution of the commands,
+		// when it is known which area of the image is actually needed (see executeCommands).
+		Image img(filePaths[i], 0, true);
 		if (img.getFilePath() != "")
 		{
 			this->images.push_back(img);
@@ -41,140 +47,261 @@ void Session::execute()
 	{
 		return;
 	}
+
+	// The commands are only recorded for every image here. An image executes them when its pixels are needed:
+	// when it is saved (see save) or, for the images of a collage, right now.
+	const std::shared_ptr<const CommandChain> chain = std::make_shared<CommandChain>(CommandChain{ this->commands, this->cropInfo });
+	this->pendingChains.resize(this->images.size());
+	// The key of an image that has not executed anything yet identifies only its file
+	for (size_t i = this->imageKeys.size(); i < this->images.size(); i++)
+	{
+		const std::string path = this->images[i].getFilePath() + this->images[i].getFileExtension();
+		this->imageKeys.push_back(hashBytes(emptyHash, path.data(), path.size()));
+	}
+	// The snapshot for undo shares the pixels of the images, and a new execution cannot be redone over
+	pushExecutedState();
+	this->undoneStates.clear();
 	for (size_t i = 0; i < this->images.size(); i++)
 	{
-		// If the number of left and right rotations is equal, the program does nothing
-		if (occurances(rotateL) == occurances(rotateR) && occurances(rotateL) != 0)
-		{
-			eraseAll(rotateL);
-			eraseAll(rotateR);
-		}
-		Image collage;
-		unsigned timesCropped = 0;
-		for (size_t j = this->images[i].getCommandsToSkip(); j < this->commands.size(); j++)
+		this->pendingChains[i].push_back(PendingChain{ chain, this->images[i].getCommandsToSkip() });
+	}
+
+	// The images are independent of each other until a collage is made, so the chain of every image of a collage
+	// is executed by a different worker of the pool. The futures tell when the chain of an image is finished.
+	ThreadPool pool(this->workerCount);
+	std::vector<std::future<void>> imagesDone(this->images.size());
+	for (size_t i = 0; i < this->forCollages.size(); i++)
+	{
+		// The images of a collage are needed in memory, even in streaming mode
+		const size_t index = this->forCollages[i];
+		if (!imagesDone[index].valid())
 		{
-			switch (this->commands[j])
-			{
-			case rotateL:
-				this->images[i].rotateLeft();
-				break;
-			case rotateR:
-				this->images[i].rotateRight();
-				break;
-			case grayscale:
-				this->images[i].toGrayscale();
-				break;
-			case monochrome:
-				this->images[i].toMonochrome();
-				break;
-			case negative:
-				this->images[i].toNegative();
-				break;
-			case flipH:
-				this->images[i].flipHorizontal();
-				break;
-			case flipV:
-				this->images[i].flipVertical();
-				break;
-			case cropp:
-				this->images[i].crop(this->cropInfo[timesCropped * 4 + 0], this->cropInfo[timesCropped * 4 + 1], this->cropInfo[timesCropped * 4 + 2], this->cropInfo[timesCropped * 4 + 3]);
-				timesCropped++;
-				break;
-			default:
-				break;
-			}
+			imagesDone[index] = pool.submit([this, index] { this->executePendingChains(index, true); });
 		}
 	}
 
+	std::string orientation;
+	if (std::find(this->commands.begin(), this->commands.end(), collageH) != this->commands.end()) {
+		orientation = "horizontal";
+	}
+	else if (std::find(this->commands.begin(), this->commands.end(), collageV) != this->commands.end()) {
+		orientation = "vertical";
+	}
+
+	// A collage can only be made when both of its images are finished. While waiting for them,
+	// the workers keep executing the chains of the other images.
+	std::vector<std::future<void>> collagesDone;
 	while (this->forCollages.size() >= 2) {
-		Image collage;
+		const Image* img1 = &this->images[this->forCollages[0]];
+		const Image* img2 = &this->images[this->forCollages[1]];
+		imagesDone[this->forCollages[0]].wait();
+		imagesDone[this->forCollages[1]].wait();
+		collagesDone.push_back(pool.submit([orientation, img1, img2] {
+			Image collage;
+			if (orientation != "")
+			{
+				collage = makeCollage(orientation, *img1, *img2);
+			}
+			collage.saveImage();
+		}));
+		this->forCollages.erase(this->forCollages.begin(), this->forCollages.begin() + 2);
+	}
 
-		if (std::find(this->commands.begin(), this->commands.end(), collageH) != this->commands.end()) {
-			collage = makeCollage("horizontal", this->images[this->forCollages[0]], this->images[this->forCollages[1]]);
-		}
-		else if (std::find(this->commands.begin(), this->commands.end(), collageV) != this->commands.end()) {
-			collage = makeCollage("vertical", this->images[this->forCollages[0]], this->images[this->forCollages[1]]);
+	for (size_t i = 0; i < imagesDone.size(); i++)
+	{
+		if (imagesDone[i].valid())
+		{
+			imagesDone[i].get();
 		}
-
-		collage.saveImage();
-		this->forCollages.erase(this->forCollages.begin(), this->forCollages.begin() + 2);
+	}
+	for (size_t i = 0; i < collagesDone.size(); i++)
+	{
+		collagesDone[i].get();
 	}
 	this->commands.clear();
 }
 
-void Session::addCommand(const std::string& command)
+// The key of a state is extended with every command of the chain that the image executes, including the
+// coordinates of its crops, so equal keys mean the same file with the same sequence of commands applied to it.
+static uint64_t extendKey(uint64_t key, const CommandChain& chain, size_t firstCommand)
 {
-	if (command == "grayscale" && occurances(grayscale) == 0)
+	unsigned timesCropped = 0;
+	for (size_t j = firstCommand; j < chain.commands.size(); j++)
 	{
-		commands.push_back(grayscale);
+		const Command command = chain.commands[j];
+		key = hashBytes(key, &command, sizeof(command));
+		if (command == cropp)
+		{
+			key = hashBytes(key, &chain.cropInfo[timesCropped * 4], 4 * sizeof(unsigned short));
+			timesCropped++;
+		}
 	}
-	else if (command == "monochrome" && occurances(monochrome) == 0)
+	return key;
+}
+
+void Session::executePendingChains(size_t index, bool needsPixels)
+{
+	if (index >= this->pendingChains.size() || this->pendingChains[index].empty())
 	{
-		commands.push_back(monochrome);
+		return;
 	}
-	else if (command == "rotate left")
+	std::vector<PendingChain>& chains = this->pendingChains[index];
+	Image& image = this->images[index];
+
+	// keys[i] is the key of the state after the first i chains. The chains before the deepest state that is in the
+	// cache are not executed at all; the image continues from a copy of that state. Even the current state (i = 0)
+	// is worth taking from the cache, because a saved image has released its pixels and would read its file again.
+	std::vector<uint64_t> keys(1, this->imageKeys[index]);
+	for (size_t i = 0; i < chains.size(); i++)
 	{
-		unsigned occurancesL = occurances(rotateL);
-		if (occurancesL <= 1)
-		{
-			commands.push_back(rotateL);
-		}
-		else if (occurancesL == 2)
-		{
-			eraseAll(rotateL);
-			commands.push_back(rotateR);
-		}
+		keys.push_back(extendKey(keys.back(), *chains[i].chain, chains[i].firstCommand));
 	}
-	else if (command == "rotate right")
+	const bool cached = !this->streaming && this->cache->getBudget() > 0;
+	size_t firstChain = 0;
+	for (size_t i = chains.size() + 1; cached && i-- > 0;)
 	{
-		unsigned occurancesR = occurances(rotateR);
-		if (occurancesR <= 1)
-		{
-			commands.push_back(rotateR);
-		}
-		else if (occurancesR == 2)
+		std::shared_ptr<const Image> state = this->cache->find(keys[i]);
+		if (state != nullptr)
 		{
-			eraseAll(rotateR);
-			commands.push_back(rotateL);
+			const unsigned short commandsToSkip = image.getCommandsToSkip();
+			image = *state;
+			image.setCommandsToSkip(commandsToSkip);
+			firstChain = i;
+			break;
 		}
 	}
-	else if (command == "flip horizontal")
+	for (size_t i = firstChain; i < chains.size(); i++)
 	{
-		if (occurances(flipH) == 0)
-		{
-			commands.push_back(flipH);
-		}
-		else
-		{
-			eraseFirstOccurance(flipH);
-		}
+		executeCommands(image, *chains[i].chain, chains[i].firstCommand, needsPixels);
 	}
-	else if (command == "flip vertical")
+	if (cached && firstChain < chains.size())
 	{
-		if (occurances(flipV) == 0)
-		{
-			commands.push_back(flipV);
-		}
-		else
+		this->cache->insert(keys.back(), image);
+	}
+	this->imageKeys[index] = keys.back();
+	chains.clear();
+}
+
+FoldedChain foldChain(Image& image, const CommandChain& chain, size_t firstCommand)
+{
+	// The commands are not executed one by one. The rotations and flips are collected into one transformation,
+	// which moves every pixel only once. Grayscale, monochrome and negative are collected into one chain of point
+	// operations, which changes every pixel only once. The point operations do not depend on the positions of
+	// the pixels, so the chain is executed at the end, when the image has been cropped and has the fewest pixels.
+	// A crop depends on the positions, so its area is mapped back through the transformation collected so far
+	// and the crop is done first, on the pixels that have not been moved yet. The transformation is applied
+	// at the end as well and moves only the cropped pixels.
+	FoldedChain folded;
+	Transform& transform = folded.transform;
+	PointOps& pointOps = folded.pointOps;
+	unsigned timesCropped = 0;
+	for (size_t j = firstCommand; j < chain.commands.size(); j++)
+	{
+		switch (chain.commands[j])
 		{
-			eraseFirstOccurance(flipV);
+		case rotateL:
+			transform.rotateLeft();
+			break;
+		case rotateR:
+			transform.rotateRight();
+			break;
+		case flipH:
+			transform.flipHorizontal();
+			break;
+		case flipV:
+			transform.flipVertical();
+			break;
+		case grayscale:
+			pointOps.add(grayscaleOperation);
+			break;
+		case monochrome:
+			pointOps.add(monochromeOperation);
+			break;
+		case negative:
+			pointOps.add(negativeOperation);
+			break;
+		case cropp:
+			image.crop(chain.cropInfo[timesCropped * 4 + 0], chain.cropInfo[timesCropped * 4 + 1], chain.cropInfo[timesCropped * 4 + 2], chain.cropInfo[timesCropped * 4 + 3], transform);
+			timesCropped++;
+			break;
+		default:
+			break;
 		}
 	}
-	else if (command == "negative")
-	{
-		commands.push_back(negative);
-	}
-	else if (command == "make collage horizontal")
+	return folded;
+}
+
+void Session::executeCommands(Image& image, const CommandChain& chain, size_t firstCommand, bool needsPixels)
+{
+	const FoldedChain folded = foldChain(image, chain, firstCommand);
+	image.transform(folded.transform);
+	image.applyPointOps(folded.pointOps);
+
+	// An image whose pixels have not been read yet has only recorded the crops, the horizontal flips and the point
+	// operations, and the crops are done first, so only the area that is left is read from the file. Any other
+	// transformation has already loaded that area. In streaming mode the image stays on disk until it is saved,
+	// unless it is part of a collage.
+	if (!this->streaming || needsPixels)
 	{
-		commands.push_back(collageH);
+		image.load();
 	}
-	else if (command == "make collage vertical")
-	{
-		commands.push_back(collageV);
+}
+
+void Session::setStreaming(bool streaming)
+{
+	this->streaming = streaming;
+}
+
+bool Session::isStreaming() const
+{
+	return this->streaming;
+}
+
+void Session::setWorkerCount(unsigned workerCount)
+{
+	this->workerCount = workerCount;
+}
+
+unsigned Session::getWorkerCount() const
+{
+	return this->workerCount;
+}
+
+void Session::setCacheBudget(size_t bytes)
+{
+	this->cache->setBudget(bytes);
+}
+
+size_t Session::getCacheBudget() const
+{
+	return this->cache->getBudget();
+}
+
+bool parseCommand(const std::string& text, Command& command)
+{
+	static const std::pair<const char*, Command> names[] = {
+		{ "grayscale", grayscale }, { "monochrome", monochrome }, { "negative", negative },
+		{ "rotate left", rotateL }, { "rotate right", rotateR }, { "flip horizontal", flipH }, { "flip vertical", flipV },
+		{ "crop", cropp }, { "make collage vertical", collageV }, { "make collage horizontal", collageH },
+	};
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		if (text == names[i].first)
+		{
+			command = names[i].second;
+			return true;
+		}
 	}
-	else if (command == "crop")
+	return false;
+}
+
+void Session::addCommand(const std::string& text)
+{
+	// Grayscale and monochrome can only be queued once
+	Command command;
+	if (parseCommand(text, command) && !((command == grayscale || command == monochrome) && occurances(command) > 0))
 	{
-		commands.push_back(cropp);
+		commands.push_back(command);
 	}
 	else
 	{
@@ -184,7 +311,7 @@ void Session::addCommand(const std::string& command)
 
 void Session::addImage(const std::string& filePath)
 {
-	Image newImg(filePath, this->commands.size());
+	Image newImg(filePath, this->commands.size(), true);
 	this->images.push_back(newImg);
 	std::cout << "Image \"" << newImg.getFilePath() << "\" added\n";
 }
@@ -230,6 +357,8 @@ void Session::queueForCollage(const std::vector<std::string>& images)
 	}
 }
 
+// The coordinates of the undone crops and the images of the undone collages are kept as stacks: undo moves the
+// last group of values to the end of the history, and redo moves the last group of the history back.
 void Session::undo()
 {
 	if (this->commands.size() > 0)
@@ -237,22 +366,23 @@ void Session::undo()
 		this->undoneCommands.push_back(this->commands[this->commands.size() - 1]);
 		if (this->commands.back() == cropp)
 		{
-			for (size_t i = 0; i < 4; i++)
-			{
-				this->cropInfoHistory.insert(this->cropInfoHistory.begin(), this->cropInfo.back());
-				this->cropInfo.pop_back();
-			}
+			this->cropInfoHistory.insert(this->cropInfoHistory.end(), this->cropInfo.end() - 4, this->cropInfo.end());
+			this->cropInfo.resize(this->cropInfo.size() - 4);
 		}
 		else if (this->commands.back() == collageH || this->commands.back() == collageV)
 		{
-			for (size_t i = 0; i < 2; i++)
-			{
-				this->forCollagesHistory.insert(this->forCollagesHistory.begin(), this->forCollages.back());
-				this->forCollages.pop_back();
-			}
+			this->forCollagesHistory.insert(this->forCollagesHistory.end(), this->forCollages.end() - 2, this->forCollages.end());
+			this->forCollages.resize(this->forCollages.size() - 2);
 		}
 		this->commands.pop_back();
 	}
+	else if (this->executedStates.size() > 0)
+	{
+		// Both states share the pixels of the images, so going back and forth copies no pixels
+		this->undoneStates.push_back(getState());
+		restoreState(this->executedStates.back());
+		this->executedStates.pop_back();
+	}
 	else
 	{
 		std::cout << "There is no commands to be undone\n";
@@ -264,24 +394,24 @@ void Session::redo()
 	if (this->undoneCommands.size() > 0)
 	{
 		this->commands.push_back(this->undoneCommands[this->undoneCommands.size() - 1]);
-		if (this->undoneCommands.back() == cropp)
+		if (this->undoneCommands.back() == cropp && this->cropInfoHistory.size() >= 4)
 		{
-			for (size_t i = 0; i < 4; i++)
-			{
-				this->cropInfo.push_back(this->cropInfoHistory[i]);
-			}
-			this->cropInfoHistory.erase(this->cropInfoHistory.begin(), this->cropInfoHistory.size() >= 4 ? this->cropInfoHistory.begin() + 4 : this->cropInfoHistory.end());
+			this->cropInfo.insert(this->cropInfo.end(), this->cropInfoHistory.end() - 4, this->cropInfoHistory.end());
+			this->cropInfoHistory.resize(this->cropInfoHistory.size() - 4);
 		}
-		else if (this->undoneCommands.back() == collageH || this->commands.back() == collageV)
+		else if ((this->undoneCommands.back() == collageH || this->commands.back() == collageV) && this->forCollagesHistory.size() >= 2)
 		{
-			for (size_t i = 0; i < 2; i++)
-			{
-				this->forCollages.push_back(this->forCollagesHistory[i]);
-			}
-			this->forCollagesHistory.erase(this->forCollagesHistory.begin(), this->forCollagesHistory.size() >= 2 ? this->forCollagesHistory.begin() + 2 : this->forCollagesHistory.end());
+			this->forCollages.insert(this->forCollages.end(), this->forCollagesHistory.end() - 2, this->forCollagesHistory.end());
+			this->forCollagesHistory.resize(this->forCollagesHistory.size() - 2);
 		}
 		this->undoneCommands.pop_back();
 	}
+	else if (this->undoneStates.size() > 0)
+	{
+		pushExecutedState();
+		restoreState(this->undoneStates.back());
+		this->undoneStates.pop_back();
+	}
 	else
 	{
 		std::cout << "No commands to be redone\n";
@@ -292,6 +422,33 @@ void Session::clearUndoneCommands()
 {
 	// For after recieving a new command after redo
 	this->undoneCommands.clear();
+	this->undoneStates.clear();
+}
+
+SessionState Session::getState() const
+{
+	return SessionState{ this->images, this->pendingChains, this->imageKeys };
+}
+
+void Session::pushExecutedState()
+{
+	this->executedStates.push_back(getState());
+	if (this->executedStates.size() > maxUndoDepth)
+	{
+		this->executedStates.erase(this->executedStates.begin());
+	}
+}
+
+// Only the images that had executed something when the state was taken (those with a key) are restored. The
+// others have not changed since they were added, so they stay as they are.
+void Session::restoreState(const SessionState& state)
+{
+	for (size_t i = 0; i < state.imageKeys.size(); i++)
+	{
+		this->images[i] = state.images[i];
+		this->pendingChains[i] = state.pendingChains[i];
+		this->imageKeys[i] = state.imageKeys[i];
+	}
 }
 
 void Session::printInfo()
@@ -327,6 +484,12 @@ void Session::printPendingTransormations()
 			std::cout << "rotate left "; break;
 		case rotateR:
 			std::cout << "rotate right "; break;
+		case flipH:
+			std::cout << "flip horizontal "; break;
+		case flipV:
+			std::cout << "flip vertical "; break;
+		case cropp:
+			std::cout << "crop "; break;
 		case collageH:
 			std::cout << "collage horizontal "; break;
 		case collageV:
@@ -340,6 +503,7 @@ void Session::saveAs(const std::string& filePath)
 {
 	if (this->images.size() > 0)
 	{
+		executePendingChains(0, false);
 		Image newImg(this->images[0]);
 		newImg.setFilePath(filePath);
 		newImg.saveImage();
@@ -350,11 +514,23 @@ void Session::saveAs(const std::string& filePath)
 	}
 }
 
+// Every image executes its pending commands, is saved and releases its pixels in one task of the pool, so at any
+// time only the images that the workers are saving (and those kept for collages) are in memory.
 void Session::save()
 {
+	ThreadPool pool(this->workerCount);
+	std::vector<std::future<void>> imagesSaved;
 	for (size_t i = 0; i < this->images.size(); i++)
 	{
-		this->images[i].saveImage();
+		imagesSaved.push_back(pool.submit([this, i] {
+			this->executePendingChains(i, false);
+			this->images[i].saveImage();
+			this->images[i].release();
+		}));
+	}
+	for (size_t i = 0; i < imagesSaved.size(); i++)
+	{
+		imagesSaved[i].get();
 	}
 }
 
@@ -371,30 +547,6 @@ unsigned Session::occurances(const Command command)
 	return count;
 }
 
-void Session::eraseAll(const Command& command)
-{
-	for (size_t i = 0; i < this->commands.size(); i++)
-	{
-		if (this->commands[i] == command)
-		{
-			this->commands.erase(this->commands.begin() + i);
-			i--;
-		}
-	}
-}
-
-void Session::eraseFirstOccurance(const Command& command)
-{
-	for (size_t i = 0; i < this->commands.size(); i++)
-	{
-		if (this->commands[i] == command)
-		{
-			this->commands.erase(this->commands.begin() + i);
-			break;
-		}
-	}
-}
-
 bool Session::containsImage(const std::string& filePath)
 {
 	for (size_t i = 0; i < this->images.size(); i++)
@@ -1,5 +1,7 @@
 #pragma once
 #include "Image.h"
+#include "StateCache.h"
+#include <memory>
 
 // Enumeration defining the available image processing commands
 enum Command
@@ -16,11 +18,54 @@ enum Command
 	collageH,      // Creates a horizontal collage
 };
 
+// The commands queued before one call to execute, together with the coordinates of their crops
+struct CommandChain
+{
+	std::vector<Command> commands;
+	std::vector<unsigned short> cropInfo;
+};
+
+// Translates the text of a command, as it is typed by the user, into a Command. Returns false for unknown text.
+bool parseCommand(const std::string& text, Command& command);
+
+// The commands of a chain after folding: the rotations and flips become one transformation and grayscale,
+// monochrome and negative one chain of point operations. The crops are not part of it - they are done on the
+// image while the chain is folded (see foldChain).
+struct FoldedChain
+{
+	Transform transform;
+	PointOps pointOps;
+};
+
+// Folds the commands of a chain, starting from firstCommand, and crops the image on the way. An image that is not
+// loaded only records the crops, so loading it afterwards reads just the area they leave. The transformation
+// and the point operations are then applied by the caller, in this order.
+FoldedChain foldChain(Image& image, const CommandChain& chain, size_t firstCommand);
+
+// A chain that an image has not executed yet. Every image that is part of the session when execute is called
+// shares the same chain, starting from the first command that applies to it.
+struct PendingChain
+{
+	std::shared_ptr<const CommandChain> chain;
+	size_t firstCommand;
+};
+
+// The images of a session as they were before one call to execute, together with what they still had to execute.
+// The pixels of the images are shared with the session until either of them changes (see Image::samples), so a
+// snapshot costs only the pixels that the execution actually changes.
+struct SessionState
+{
+	std::vector<Image> images;
+	std::vector<std::vector<PendingChain>> pendingChains;
+	std::vector<uint64_t> imageKeys;
+};
 
 // Class representing a session that manages image operations and transformations
 class Session
 {
 private:
+	// Every snapshot keeps the pixels that the executions after it changed, so only the latest ones are kept
+	static const size_t maxUndoDepth = 16;
 	static unsigned idGenerator; // Static variable to generate unique session IDs
 	unsigned id;                // Unique identifier for the session
 	std::vector<Image> images;       // Vector to store images associated with the session
@@ -31,21 +76,46 @@ private:
 	std::vector<unsigned short> cropInfo; // Vector to store cropping information
 	std::vector<unsigned short> cropInfoHistory; // History of cropping information for undo/redo functionality
 	bool valid = false;         // Flag indicating whether the session is valid
+	unsigned workerCount = 0;   // The number of threads that execute the commands, 0 means one for every processor core
+	bool streaming = false;     // Whether the images are streamed from their files instead of being loaded (see Image::probe)
+	std::vector<std::vector<PendingChain>> pendingChains; // The chains every image still has to execute, in order
+	std::vector<uint64_t> imageKeys; // The key of the current state of every image in the cache (see StateCache)
+	std::shared_ptr<StateCache> cache; // The states of the images after the chains they have executed
+	std::vector<SessionState> executedStates; // The state before every execution, the latest one last
+	std::vector<SessionState> undoneStates;   // The states that redo restores, the latest undone one last
 
 public:
 	// Constructors of the class:
 	Session();
-	Session(std::vector<std::string> filePaths);
+	Session(std::vector<std::string> filePaths, bool streaming = false);
 
 	unsigned getId() const; // Returns the unique identifier of the session
 	bool isValid() const;   // Checks if the session is valid
 	void execute();			// Executes the queued commands on the images in the session
+	void setWorkerCount(unsigned workerCount); // Sets the number of threads used by execute, 0 means one for every processor core
+	unsigned getWorkerCount() const;
+	// The images are only probed when they are added. execute loads only the images of collages; every other image
+	// executes its commands when it is saved, and its pixels are released as soon as it is written, so a session keeps
+	// about one image per worker in memory instead of all of them. Only the area left by the crops is read. In streaming
+	// mode the images are not loaded even then: a command chain that needs only one row at a time (point operations,
+	// horizontal flips and crops) is executed while saving, row by row, with memory that does not depend on the
+	// size of the image. Any other chain loads the image.
+	void setStreaming(bool streaming);
+	bool isStreaming() const;
+	// The states of the images after every execution are kept in a cache of at most this many bytes of pixels
+	// (256 MiB by default), and an image continues from the deepest state that is still there, so a long
+	// session pays only for the commands that were added since. 0 turns the cache off. Streamed images are
+	// never cached.
+	void setCacheBudget(size_t bytes);
+	size_t getCacheBudget() const;
 	void addCommand(const std::string&);		 // Adds a command to the session
 	void addImage(const std::string& filePath); // Adds an image to the session from a specified file path
 	void crop(std::vector<std::string> coordinates); // Crops the current image based on the provided coordinates
 	void queueForCollage(const std::vector<std::string>& images); // Queues images for collage creation
-	void undo(); // Undoes the last executed command
-	void redo(); // Redoes the last undone command
+	// Undoes the last queued command. When no command is queued, the last execution is undone instead: the
+	// images go back to the snapshot taken before it, and the collages it saved stay on the disk.
+	void undo();
+	void redo(); // Redoes the last undone command, or the last undone execution
 	void clearUndoneCommands();			// Clears the list of undone commands
 	void printInfo();					// Prints information about the session
 	void printImagesNames();			// Prints the names of the images in the session
@@ -55,8 +125,12 @@ public:
 
 private:
 	// Private helper functions
-	void eraseAll(const Command&);
-	void eraseFirstOccurance(const Command&);
 	unsigned occurances(const Command command);
 	bool containsImage(const std::string& filePath);
+	// Executes the commands of a chain, starting from firstCommand, on one image
+	void executeCommands(Image& image, const CommandChain& chain, size_t firstCommand, bool needsPixels);
+	void executePendingChains(size_t index, bool needsPixels); // Brings the image with the given index up to date
+	SessionState getState() const;
+	void pushExecutedState(); // Saves the current state for undo, dropping the oldest one past maxUndoDepth
+	void restoreState(const SessionState& state); // Restores the images that were in the session at the time of the state
 };
\ No newline at end of file
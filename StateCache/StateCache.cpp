@@ -0,0 +1,90 @@
+#include "StateCache.h"
+
+StateCache::StateCache(size_t budget) : budget(budget), used(0) { }
+
+void StateCache::setBudget(size_t budget)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->budget = budget;
+	evict(budget);
+}
+
+size_t StateCache::getBudget() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->budget;
+}
+
+size_t StateCache::getUsedBytes() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->used;
+}
+
+std::shared_ptr<const Image> StateCache::find(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto found = this->index.find(key);
+	if (found == this->index.end())
+	{
+		return nullptr;
+	}
+	// Moving the entry to the front of the list keeps the iterators valid
+	this->entries.splice(this->entries.begin(), this->entries, found->second);
+	return found->second->image;
+}
+
+// Copying the image copies no pixels: the copy shares the buffer of the image, and whichever of them changes
+// the pixels first gets a buffer of its own (copy on write, see Image::samples). The states are never changed
+// after they are stored, so a state that is being used by a session stays valid even when it is dropped from
+// the cache in the meantime.
+void StateCache::insert(uint64_t key, const Image& image)
+{
+	const size_t size = image.getStride() * image.getHeight();
+	if (!image.isLoaded() || size > getBudget())
+	{
+		return;
+	}
+	std::shared_ptr<const Image> copy = std::make_shared<Image>(image);
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto found = this->index.find(key);
+	if (found != this->index.end())
+	{
+		this->used -= found->second->size;
+		this->entries.erase(found->second);
+		this->index.erase(found);
+	}
+	evict(this->budget >= size ? this->budget - size : 0);
+	this->entries.push_front(Entry{ key, copy, size });
+	this->index[key] = this->entries.begin();
+	this->used += size;
+}
+
+void StateCache::clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->entries.clear();
+	this->index.clear();
+	this->used = 0;
+}
+
+void StateCache::evict(size_t budget)
+{
+	while (this->used > budget && !this->entries.empty())
+	{
+		this->used -= this->entries.back().size;
+		this->index.erase(this->entries.back().key);
+		this->entries.pop_back();
+	}
+}
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Image.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/* Keeps copies of images as they were after a sequence of commands, so that a session that executes more
+commands on an image can continue from the deepest state it already has instead of starting from the file
+again. Every state is stored under a key that identifies the file the image came from together with the whole
+sequence of commands applied to it (see Session). The pixels of all states take at most budget bytes, and when
+a new state does not fit, the states that were used least recently are dropped. The images of a session are
+executed by several workers at once, so every function locks the cache. */
+
+class StateCache
+{
+private:
+	struct Entry
+	{
+		uint64_t key;
+		std::shared_ptr<const Image> image;
+		size_t size; // The number of bytes of pixels in the image
+	};
+	std::list<Entry> entries; // The most recently used state first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index; // The entry of every key
+	size_t budget; // The maximum number of bytes of all states together
+	size_t used;   // The number of bytes of the stored states
+	mutable std::mutex mutex;
+
+public:
+	explicit StateCache(size_t budget);
+	StateCache(const StateCache&) = delete;
+	StateCache& operator=(const StateCache&) = delete;
+
+	void setBudget(size_t budget); // Drops the states that no longer fit. A budget of 0 turns the cache off.
+	size_t getBudget() const;
+	size_t getUsedBytes() const;
+	// Returns the state stored under the key, or nullptr. The state becomes the most recently used one.
+	std::shared_ptr<const Image> find(uint64_t key);
+	// Stores a copy of a loaded image under the key. Images that are not loaded and images larger than
+	// the whole budget are not stored.
+	void insert(uint64_t key, const Image& image);
+	void clear();
+
+private:
+	void evict(size_t budget); // Drops the least recently used states until at most budget bytes are used
+};
+
+// Continues a 64-bit FNV-1a hash with size bytes of data. The keys of the states are built with it, one
+// command at a time, so the key of a longer sequence is computed from the key of its prefix.
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
+const uint64_t emptyHash = 14695981039346656037ull; // The hash of no bytes at all
@@ -0,0 +1,69 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned workerCount) : stopping(false)
+{
+	if (workerCount == 0)
+	{
+		workerCount = getDefaultWorkerCount();
+	}
+	for (unsigned i = 0; i < workerCount; i++)
+	{
+		this->workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->taskAdded.notify_all();
+	for (size_t i = 0; i < this->workers.size(); i++)
+	{
+		this->workers[i].join();
+	}
+}
+
+unsigned ThreadPool::getWorkerCount() const
+{
+	return (unsigned)this->workers.size();
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+	std::packaged_task<void()> packagedTask(std::move(task));
+	std::future<void> result = packagedTask.get_future();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->tasks.push(std::move(packagedTask));
+	}
+	this->taskAdded.notify_one();
+	return result;
+}
+
+unsigned ThreadPool::getDefaultWorkerCount()
+{
+	// hardware_concurrency can return 0 when the number of cores is not known
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores > 0 ? cores : 1;
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->taskAdded.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+			if (this->tasks.empty())
+			{
+				return; // Only reached when the pool is stopping
+			}
+			task = std::move(this->tasks.front());
+			this->tasks.pop();
+		}
+		task();
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/* A fixed set of worker threads that execute tasks from a shared queue. The images of a session are
+independent of each other until a collage is made, so their command chains can be executed at the same
+time, each of them by a different worker. */
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers; // The threads that execute the tasks
+	std::queue<std::packaged_task<void()>> tasks; // The tasks that are waiting for a free worker
+	std::mutex mutex; // Protects the queue and the stopping flag
+	std::condition_variable taskAdded; // Wakes up a sleeping worker when a task is added or the pool is stopped
+	bool stopping; // Set by the destructor. The workers finish the remaining tasks and exit.
+
+public:
+	// Starts workerCount threads. A count of 0 means one thread for every processor core.
+	ThreadPool(unsigned workerCount = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool(); // Waits for all queued tasks to finish
+
+	unsigned getWorkerCount() const;
+	// Queues a task. The returned future becomes ready when the task has been executed.
+	std::future<void> submit(std::function<void()> task);
+
+	// The number of workers used when no count is given
+	static unsigned getDefaultWorkerCount();
+
+private:
+	void work(); // The loop executed by every worker
+};
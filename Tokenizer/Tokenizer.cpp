@@ -0,0 +1,284 @@
+#include "Tokenizer.h"
+#include <algorithm>
+
+Tokenizer::Tokenizer() : buffer(bufferSize + padding + 8, 0), position(nullptr), end(nullptr), endOfFile(false)
+{
+	this->position = this->end = this->buffer.data();
+}
+
+bool Tokenizer::open(const std::string& filePath)
+{
+	this->file.open(filePath, std::ios::binary);
+	this->position = this->end = this->buffer.data();
+	this->endOfFile = !this->file.is_open();
+	return this->file.is_open();
+}
+
+void Tokenizer::refill()
+{
+	if (this->endOfFile)
+	{
+		return;
+	}
+	char* data = this->buffer.data();
+	const size_t remaining = this->end - this->position;
+	std::memmove(data, this->position, remaining);
+	const size_t count = (size_t)this->file.rdbuf()->sgetn(data + remaining, bufferSize + padding - remaining);
+	this->position = data;
+	this->end = data + remaining + count;
+	if (count == 0)
+	{
+		this->endOfFile = true;
+	}
+	// The digit scanner reads eight bytes at a time, so the bytes after the data must not look like digits.
+	std::memset((char*)this->end, 0, 8);
+}
+
+int Tokenizer::get()
+{
+	if (this->position == this->end)
+	{
+		refill();
+		if (this->position == this->end)
+		{
+			return EOF;
+		}
+	}
+	return (unsigned char)*this->position++;
+}
+
+int Tokenizer::peek()
+{
+	if (this->position == this->end)
+	{
+		refill();
+		if (this->position == this->end)
+		{
+			return EOF;
+		}
+	}
+	return (unsigned char)*this->position;
+}
+
+bool Tokenizer::skipSeparators()
+{
+	while (true)
+	{
+		if (this->end - this->position < (ptrdiff_t)padding)
+		{
+			refill();
+			if (this->position == this->end)
+			{
+				return false;
+			}
+		}
+		const char c = *this->position;
+		if (isWhitespace(c))
+		{
+			this->position++;
+		}
+		else if (c == '#')
+		{
+			// A comment ends at the end of the line, which may be in the next part of the file
+			const char* lineEnd;
+			while ((lineEnd = (const char*)std::memchr(this->position, '\n', this->end - this->position)) == nullptr)
+			{
+				this->position = this->end;
+				refill();
+				if (this->position == this->end)
+				{
+					return false;
+				}
+			}
+			this->position = lineEnd + 1;
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+bool Tokenizer::readNumber(unsigned& value)
+{
+	return nextNumber(value);
+}
+
+// The values of the plain formats are read in a tight loop. After a refill, no number that starts more than
+// padding bytes before the end of the data can cross that end, so the end is checked once per part of the buffer
+// instead of once per character. At the end of the file the zero bytes after the data stop every number.
+template <typename Sample, bool Store>
+bool Tokenizer::scanNumbers(Sample* dst, size_t count, size_t repeat)
+{
+	size_t i = 0;
+	while (i < count)
+	{
+		if (this->end - this->position <= (ptrdiff_t)padding)
+		{
+			refill();
+			if (this->position == this->end)
+			{
+				return false;
+			}
+		}
+		const char* safeEnd = this->endOfFile ? this->end : this->end - padding;
+		const char* current = this->position;
+		bool comment = false;
+		while (i < count && current < safeEnd)
+		{
+			const char c = *current;
+			if (isDigit(c))
+			{
+				const unsigned value = readDigits(current, this->end);
+				// A number must be followed by a separator
+				const char next = *current;
+				if (isWhitespace(next))
+				{
+					// Most numbers are followed by exactly one separator, which is consumed here without another iteration
+					current++;
+				}
+				else if (next != '#' && current != this->end)
+				{
+					this->position = current;
+					return false;
+				}
+				if (Store)
+				{
+					const Sample sample = value > (Sample)~0 ? 0 : (Sample)value;
+					for (size_t j = 0; j < repeat; j++)
+					{
+						dst[j] = sample;
+					}
+					dst += repeat;
+				}
+				i++;
+			}
+			else if (isWhitespace(c))
+			{
+				current++;
+			}
+			else if (c == '#')
+			{
+				comment = true;
+				break;
+			}
+			else
+			{
+				this->position = current;
+				return false;
+			}
+		}
+		this->position = current;
+		// The comment can reach into the next part of the file, so the part is set up again after it
+		if (comment && !skipSeparators())
+		{
+			return false;
+		}
+		if (i < count && this->endOfFile && this->position >= this->end)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Tokenizer::readNumbers(unsigned char* dst, size_t count, size_t repeat)
+{
+	return scanNumbers<unsigned char, true>(dst, count, repeat);
+}
+
+bool Tokenizer::readNumbers(unsigned short* dst, size_t count, size_t repeat)
+{
+	return scanNumbers<unsigned short, true>(dst, count, repeat);
+}
+
+bool Tokenizer::skipNumbers(size_t count)
+{
+	return scanNumbers<unsigned char, false>(nullptr, count, 0);
+}
+
+bool Tokenizer::readBits(unsigned char* dst, size_t count, size_t repeat)
+{
+	unsigned char bit;
+	for (size_t i = 0; i < count; i++, dst += repeat)
+	{
+		if (!nextBit(bit))
+		{
+			return false;
+		}
+		for (size_t j = 0; j < repeat; j++)
+		{
+			dst[j] = bit;
+		}
+	}
+	return true;
+}
+
+bool Tokenizer::skipBits(size_t count)
+{
+	unsigned char bit;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!nextBit(bit))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Tokenizer::readBytes(unsigned char* dst, size_t count)
+{
+	// What is left in the buffer is copied first, and the rest is read directly from the file
+	const size_t buffered = std::min(count, (size_t)(this->end - this->position));
+	std::memcpy(dst, this->position, buffered);
+	this->position += buffered;
+	count -= buffered;
+	if (count == 0)
+	{
+		return true;
+	}
+	if (count >= bufferSize)
+	{
+		return (size_t)this->file.rdbuf()->sgetn((char*)dst + buffered, count) == count;
+	}
+	refill();
+	if ((size_t)(this->end - this->position) < count)
+	{
+		return false;
+	}
+	std::memcpy(dst + buffered, this->position, count);
+	this->position += count;
+	return true;
+}
+
+bool Tokenizer::skipBytes(size_t count)
+{
+	const size_t buffered = std::min(count, (size_t)(this->end - this->position));
+	this->position += buffered;
+	count -= buffered;
+	if (count == 0)
+	{
+		return true;
+	}
+	// The rest of the bytes are not read at all
+	const std::streampos current = this->file.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+	const std::streampos last = this->file.rdbuf()->pubseekoff(0, std::ios::end, std::ios::in);
+	if (current == std::streampos(-1) || last - current < (std::streamoff)count)
+	{
+		this->endOfFile = true;
+		return false;
+	}
+	this->file.rdbuf()->pubseekpos(current + (std::streamoff)count, std::ios::in);
+	return true;
+}
+
+size_t Tokenizer::getOffset()
+{
+	const std::streampos current = this->file.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+	if (current == std::streampos(-1))
+	{
+		return 0;
+	}
+	return (size_t)(std::streamoff)current - (size_t)(this->end - this->position);
+}
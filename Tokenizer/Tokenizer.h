@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* Reads a Netpbm file through one large buffer. The plain formats are split into numbers without caring
+how the values are wrapped into lines: any amount of whitespace and comments (from '#' to the end of the
+line) can separate them. The digits of a number are converted eight at a time with ordinary 64-bit integer
+arithmetic (SWAR - SIMD within a register). The raw formats are read as blocks of bytes from the same buffer,
+and large blocks that are not needed are skipped by moving the file position. */
+
+class Tokenizer
+{
+private:
+	std::ifstream file;
+	std::vector<char> buffer; // The data read from the file, followed by a few zero bytes (see readDigits)
+	const char* position;     // The next character to be processed
+	const char* end;          // The end of the data in the buffer
+	bool endOfFile;           // True when the whole file has been read into the buffer
+
+public:
+	Tokenizer();
+	Tokenizer(const Tokenizer&) = delete;
+	Tokenizer& operator=(const Tokenizer&) = delete;
+
+	bool open(const std::string& filePath);
+	int get();  // Returns the next character, or EOF at the end of the file
+	int peek(); // Returns the next character without consuming it
+
+	// Skips whitespace and comments and reads a number. Returns false if the next token is not a number.
+	bool readNumber(unsigned& value);
+	// Reads count numbers and writes every one of them repeat times to dst. Numbers that do not fit into a value of
+	// dst (larger than 255 or 65535) are written as 0. Returns false if the file ends (or something that is not a number
+	// appears) before count numbers have been read.
+	bool readNumbers(unsigned char* dst, size_t count, size_t repeat);
+	bool readNumbers(unsigned short* dst, size_t count, size_t repeat);
+	bool skipNumbers(size_t count);
+	// The values of plain .pbm files are single digits, which do not have to be separated by whitespace.
+	bool readBits(unsigned char* dst, size_t count, size_t repeat);
+	bool skipBits(size_t count);
+
+	// Raw access for the binary formats
+	bool readBytes(unsigned char* dst, size_t count);
+	bool skipBytes(size_t count);
+	size_t getOffset(); // The position in the file of the next character
+
+private:
+	static const size_t bufferSize = 1 << 20;
+	static const size_t padding = 64; // The minimum amount of data that is kept available while it is being tokenized
+
+	void refill(); // Moves the unprocessed data to the beginning of the buffer and fills the rest from the file
+	bool skipSeparators(); // Skips whitespace and comments. Returns false at the end of the file.
+	template <typename Sample, bool Store>
+	bool scanNumbers(Sample* dst, size_t count, size_t repeat); // The loop behind readNumbers and skipNumbers
+
+	static bool isWhitespace(char c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+	static bool isDigit(char c)
+	{
+		return (unsigned char)(c - '0') < 10;
+	}
+
+	// These are called for every value of the image, so they are defined here, where they can be inlined.
+
+	// Reads the digits at the given position, which must be at least one, and moves the position after them.
+	// The position is passed in instead of using the member, because the compiler cannot keep a member in a
+	// register while samples are written through an unsigned char pointer, which may point anywhere.
+	static unsigned readDigits(const char*& position, const char* end)
+	{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		// Eight characters are loaded into one 64-bit number, the first of them into the lowest byte. After the
+		// XOR with '0' the digits become the values 0 to 9, and adding 0x76 to such a byte does not set its highest
+		// bit, while it does for every other character. A carry from a non-digit byte can only affect the bytes
+		// after it, so the lowest marked byte is always the first character that is not a digit.
+		uint64_t chunk;
+		std::memcpy(&chunk, position, 8);
+		const uint64_t values = chunk ^ 0x3030303030303030ull;
+		const uint64_t nonDigits = ((values + 0x7676767676767676ull) | values) & 0x8080808080808080ull;
+		if (nonDigits != 0)
+		{
+#if defined(_MSC_VER)
+			unsigned long lowestBit;
+			_BitScanForward64(&lowestBit, nonDigits);
+			const unsigned length = lowestBit / 8;
+#else
+			const unsigned length = __builtin_ctzll(nonDigits) / 8;
+#endif
+			// The digits are moved to the highest bytes, so that the missing leading digits are zeros.
+			// Then neighbouring bytes are combined pairwise into 2-digit, 4-digit and 8-digit numbers.
+			uint64_t digits = values << (64 - 8 * length);
+			digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFull;
+			digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFull;
+			digits = (digits * 10000 + (digits >> 32)) & 0x00000000FFFFFFFFull;
+			position += length;
+			return (unsigned)digits;
+		}
+#endif
+		// Numbers with eight or more digits are far too large for an image anyway, so they are simply saturated.
+		unsigned value = 0;
+		while (position < end && isDigit(*position))
+		{
+			value = std::min(value * 10 + (*position++ - '0'), 1000000u);
+		}
+		return value;
+	}
+
+	bool nextNumber(unsigned& value)
+	{
+		if (this->end - this->position < (ptrdiff_t)padding)
+		{
+			refill();
+		}
+		if (this->position < this->end && isDigit(*this->position))
+		{
+			value = readDigits(this->position, this->end);
+		}
+		else if (!skipSeparators() || !isDigit(*this->position))
+		{
+			return false;
+		}
+		else
+		{
+			value = readDigits(this->position, this->end);
+		}
+		// A number must be followed by a separator
+		return this->position == this->end || isWhitespace(*this->position) || *this->position == '#';
+	}
+
+	bool nextBit(unsigned char& bit)
+	{
+		if (this->end - this->position < (ptrdiff_t)padding)
+		{
+			refill();
+		}
+		if (this->position >= this->end || (*this->position != '0' && *this->position != '1'))
+		{
+			if (!skipSeparators() || (*this->position != '0' && *this->position != '1'))
+			{
+				return false;
+			}
+		}
+		bit = (unsigned char)(*this->position++ - '0');
+		return true;
+	}
+};
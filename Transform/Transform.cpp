@@ -0,0 +1,53 @@
+#include "Transform.h"
+#include <utility>
+
+Transform::Transform() : transposed(false), flippedH(false), flippedV(false) { }
+
+// Flipping horizontally and then transposing gives the same result as transposing and then flipping
+// vertically (and the other way around), so appending a transposition swaps the two flips.
+// A rotation to the left is a transposition followed by a vertical flip, and a rotation to the right
+// is a transposition followed by a horizontal flip.
+void Transform::rotateLeft()
+{
+	this->transposed = !this->transposed;
+	std::swap(this->flippedH, this->flippedV);
+	this->flippedV = !this->flippedV;
+}
+
+void Transform::rotateRight()
+{
+	this->transposed = !this->transposed;
+	std::swap(this->flippedH, this->flippedV);
+	this->flippedH = !this->flippedH;
+}
+
+// The two flips commute with each other, so appending a flip simply toggles it.
+void Transform::flipHorizontal()
+{
+	this->flippedH = !this->flippedH;
+}
+
+void Transform::flipVertical()
+{
+	this->flippedV = !this->flippedV;
+}
+
+bool Transform::isIdentity() const
+{
+	return !this->transposed && !this->flippedH && !this->flippedV;
+}
+
+bool Transform::isTransposed() const
+{
+	return this->transposed;
+}
+
+bool Transform::isFlippedHorizontally() const
+{
+	return this->flippedH;
+}
+
+bool Transform::isFlippedVertically() const
+{
+	return this->flippedV;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/* The rotations by 90 degrees and the flips, together with their combinations, form a group of exactly
+eight elements (the dihedral group of the square). No matter how many of these commands are queued, their
+combined effect is one of the eight elements, so instead of moving every pixel once per command, the
+Session collects them into a Transform and the image moves every pixel once for all of them. */
+
+class Transform
+{
+private:
+	// Every element of the group can be written as an optional transposition (mirroring along the main
+	// diagonal), followed by an optional horizontal flip, followed by an optional vertical flip.
+	bool transposed;
+	bool flippedH;
+	bool flippedV;
+
+public:
+	Transform(); // The identity - the image stays as it is
+
+	// Member functions that append one more command to the transformation:
+	void rotateLeft();
+	void rotateRight();
+	void flipHorizontal();
+	void flipVertical();
+
+	bool isIdentity() const;
+	bool isTransposed() const;
+	bool isFlippedHorizontally() const;
+	bool isFlippedVertically() const;
+};
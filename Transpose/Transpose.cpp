@@ -0,0 +1,340 @@
+#include "Transpose.h"
+#include "Cpu.h"
+#include <cstring>
+
+#ifdef NETPBM_X86
+#include <immintrin.h>
+#endif
+
+// The tiles are 64 x 64 pixels. For 3-byte pixels that is 12 KB of source and 12 KB of destination,
+// which together fit in the L1 cache of every processor the program is likely to run on.
+static const size_t tileSize = 64;
+
+// A block kernel transposes a block with a fixed number of rows and columns. The tiles are cut into
+// such blocks, and whatever is left at the right and bottom edges of a tile is copied pixel by pixel.
+typedef void (*BlockKernel)(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride);
+
+struct TransposeKernel
+{
+	BlockKernel kernel;
+	size_t blockRows;
+	size_t blockCols;
+};
+
+// Copies the pixels of an arbitrary block one by one. The size of the pixel is a template parameter
+// for the common sizes, so that the copying of a pixel becomes a single load and store.
+template <size_t PixelSize>
+static void transposePixels(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height)
+{
+	for (size_t row = 0; row < height; row++)
+	{
+		const unsigned char* srcPixel = src + (ptrdiff_t)row * srcStride;
+		unsigned char* dstPixel = dst + row * PixelSize;
+		for (size_t col = 0; col < width; col++, srcPixel += PixelSize, dstPixel += dstStride)
+		{
+			std::memcpy(dstPixel, srcPixel, PixelSize);
+		}
+	}
+}
+
+static void transposePixels(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height, size_t pixelSize)
+{
+	switch (pixelSize)
+	{
+	case 1:
+		transposePixels<1>(src, srcStride, dst, dstStride, width, height);
+		break;
+	case 2:
+		transposePixels<2>(src, srcStride, dst, dstStride, width, height);
+		break;
+	case 3:
+		transposePixels<3>(src, srcStride, dst, dstStride, width, height);
+		break;
+	case 6:
+		transposePixels<6>(src, srcStride, dst, dstStride, width, height);
+		break;
+	default:
+		for (size_t row = 0; row < height; row++)
+		{
+			const unsigned char* srcPixel = src + (ptrdiff_t)row * srcStride;
+			unsigned char* dstPixel = dst + row * pixelSize;
+			for (size_t col = 0; col < width; col++, srcPixel += pixelSize, dstPixel += dstStride)
+			{
+				std::memcpy(dstPixel, srcPixel, pixelSize);
+			}
+		}
+		break;
+	}
+}
+
+// The scalar block kernel. Even without SIMD instructions, working on 8 x 8 blocks inside a tile keeps
+// both the source and the destination in the cache.
+template <size_t PixelSize>
+static void transposeBlockScalar(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride)
+{
+	transposePixels<PixelSize>(src, srcStride, dst, dstStride, 8, 8);
+}
+
+#ifdef NETPBM_X86
+// 16 x 16 bytes with SSE2. Four rounds of interleaving combine pairs of rows into pairs of 2, 4, 8 and
+// finally 16 bytes, after which every register holds one column of the block.
+static void transposeBlock1SSE2(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride)
+{
+	__m128i a[16], b[16];
+	for (int i = 0; i < 16; i++)
+	{
+		a[i] = _mm_loadu_si128((const __m128i*)(src + i * srcStride));
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		b[2 * i] = _mm_unpacklo_epi8(a[2 * i], a[2 * i + 1]);
+		b[2 * i + 1] = _mm_unpackhi_epi8(a[2 * i], a[2 * i + 1]);
+	}
+	// b[2k] now holds columns 0-7 and b[2k + 1] columns 8-15 of rows 2k and 2k + 1
+	for (int i = 0; i < 4; i++)
+	{
+		a[4 * i + 0] = _mm_unpacklo_epi16(b[4 * i], b[4 * i + 2]);
+		a[4 * i + 1] = _mm_unpackhi_epi16(b[4 * i], b[4 * i + 2]);
+		a[4 * i + 2] = _mm_unpacklo_epi16(b[4 * i + 1], b[4 * i + 3]);
+		a[4 * i + 3] = _mm_unpackhi_epi16(b[4 * i + 1], b[4 * i + 3]);
+	}
+	// a[4m + q] now holds columns 4q to 4q + 3 of rows 4m to 4m + 3
+	for (int q = 0; q < 4; q++)
+	{
+		b[4 * q + 0] = _mm_unpacklo_epi32(a[q], a[4 + q]);
+		b[4 * q + 1] = _mm_unpackhi_epi32(a[q], a[4 + q]);
+		b[4 * q + 2] = _mm_unpacklo_epi32(a[8 + q], a[12 + q]);
+		b[4 * q + 3] = _mm_unpackhi_epi32(a[8 + q], a[12 + q]);
+	}
+	// b[4q] and b[4q + 1] hold columns 4q to 4q + 3 of rows 0-7, b[4q + 2] and b[4q + 3] of rows 8-15
+	for (int q = 0; q < 4; q++)
+	{
+		_mm_storeu_si128((__m128i*)(dst + (4 * q + 0) * dstStride), _mm_unpacklo_epi64(b[4 * q], b[4 * q + 2]));
+		_mm_storeu_si128((__m128i*)(dst + (4 * q + 1) * dstStride), _mm_unpackhi_epi64(b[4 * q], b[4 * q + 2]));
+		_mm_storeu_si128((__m128i*)(dst + (4 * q + 2) * dstStride), _mm_unpacklo_epi64(b[4 * q + 1], b[4 * q + 3]));
+		_mm_storeu_si128((__m128i*)(dst + (4 * q + 3) * dstStride), _mm_unpackhi_epi64(b[4 * q + 1], b[4 * q + 3]));
+	}
+}
+
+// 16 rows x 32 bytes with AVX2. The interleaving instructions work inside each 128-bit half of the
+// register, so this is the SSE2 kernel applied to two neighbouring 16 x 16 blocks at once.
+TARGET_AVX2 static void transposeBlock1AVX2(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride)
+{
+	__m256i a[16], b[16];
+	for (int i = 0; i < 16; i++)
+	{
+		a[i] = _mm256_loadu_si256((const __m256i*)(src + i * srcStride));
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		b[2 * i] = _mm256_unpacklo_epi8(a[2 * i], a[2 * i + 1]);
+		b[2 * i + 1] = _mm256_unpackhi_epi8(a[2 * i], a[2 * i + 1]);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		a[4 * i + 0] = _mm256_unpacklo_epi16(b[4 * i], b[4 * i + 2]);
+		a[4 * i + 1] = _mm256_unpackhi_epi16(b[4 * i], b[4 * i + 2]);
+		a[4 * i + 2] = _mm256_unpacklo_epi16(b[4 * i + 1], b[4 * i + 3]);
+		a[4 * i + 3] = _mm256_unpackhi_epi16(b[4 * i + 1], b[4 * i + 3]);
+	}
+	for (int q = 0; q < 4; q++)
+	{
+		b[4 * q + 0] = _mm256_unpacklo_epi32(a[q], a[4 + q]);
+		b[4 * q + 1] = _mm256_unpackhi_epi32(a[q], a[4 + q]);
+		b[4 * q + 2] = _mm256_unpacklo_epi32(a[8 + q], a[12 + q]);
+		b[4 * q + 3] = _mm256_unpackhi_epi32(a[8 + q], a[12 + q]);
+	}
+	for (int q = 0; q < 4; q++)
+	{
+		const __m256i columns[4] = {
+			_mm256_unpacklo_epi64(b[4 * q], b[4 * q + 2]),
+			_mm256_unpackhi_epi64(b[4 * q], b[4 * q + 2]),
+			_mm256_unpacklo_epi64(b[4 * q + 1], b[4 * q + 3]),
+			_mm256_unpackhi_epi64(b[4 * q + 1], b[4 * q + 3])
+		};
+		for (int k = 0; k < 4; k++)
+		{
+			// The lower half holds a column of the left block, the upper half a column of the right one
+			_mm_storeu_si128((__m128i*)(dst + (4 * q + k) * dstStride), _mm256_castsi256_si128(columns[k]));
+			_mm_storeu_si128((__m128i*)(dst + (16 + 4 * q + k) * dstStride), _mm256_extracti128_si256(columns[k], 1));
+		}
+	}
+}
+
+// Three-byte pixels do not fit the SIMD registers evenly, so four of them are first spread to
+// four bytes each, transposed as 32-bit values and packed back to three bytes each.
+static inline __m128i load12(const unsigned char* src)
+{
+	int last;
+	std::memcpy(&last, src + 8, 4);
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)src), _mm_cvtsi32_si128(last));
+}
+
+static inline void store12(unsigned char* dst, __m128i value)
+{
+	_mm_storel_epi64((__m128i*)dst, value);
+	const int last = _mm_cvtsi128_si32(_mm_srli_si128(value, 8));
+	std::memcpy(dst + 8, &last, 4);
+}
+
+TARGET_SSSE3 static void transposeBlock3SSSE3(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride)
+{
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	const __m128i x0 = _mm_shuffle_epi8(load12(src), spread);
+	const __m128i x1 = _mm_shuffle_epi8(load12(src + srcStride), spread);
+	const __m128i x2 = _mm_shuffle_epi8(load12(src + 2 * srcStride), spread);
+	const __m128i x3 = _mm_shuffle_epi8(load12(src + 3 * srcStride), spread);
+
+	const __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+	const __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+	const __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+	const __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+
+	store12(dst, _mm_shuffle_epi8(_mm_unpacklo_epi64(t0, t1), pack));
+	store12(dst + dstStride, _mm_shuffle_epi8(_mm_unpackhi_epi64(t0, t1), pack));
+	store12(dst + 2 * dstStride, _mm_shuffle_epi8(_mm_unpacklo_epi64(t2, t3), pack));
+	store12(dst + 3 * dstStride, _mm_shuffle_epi8(_mm_unpackhi_epi64(t2, t3), pack));
+}
+
+// 4 rows x 8 three-byte pixels with AVX2: the lower half of every register holds the first four pixels
+// of a row and the upper half the next four, so two 4 x 4 blocks are transposed at once.
+TARGET_AVX2 static void transposeBlock3AVX2(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride)
+{
+	const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	__m256i x[4];
+	for (int i = 0; i < 4; i++)
+	{
+		const unsigned char* row = src + i * srcStride;
+		x[i] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(load12(row)), load12(row + 12), 1), spread);
+	}
+
+	const __m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]);
+	const __m256i t1 = _mm256_unpacklo_epi32(x[2], x[3]);
+	const __m256i t2 = _mm256_unpackhi_epi32(x[0], x[1]);
+	const __m256i t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+	const __m256i columns[4] = {
+		_mm256_shuffle_epi8(_mm256_unpacklo_epi64(t0, t1), pack),
+		_mm256_shuffle_epi8(_mm256_unpackhi_epi64(t0, t1), pack),
+		_mm256_shuffle_epi8(_mm256_unpacklo_epi64(t2, t3), pack),
+		_mm256_shuffle_epi8(_mm256_unpackhi_epi64(t2, t3), pack)
+	};
+	for (int k = 0; k < 4; k++)
+	{
+		store12(dst + k * dstStride, _mm256_castsi256_si128(columns[k]));
+		store12(dst + (4 + k) * dstStride, _mm256_extracti128_si256(columns[k], 1));
+	}
+}
+#endif
+
+// Chooses the block kernel for the given pixel size and the instruction sets of the processor.
+static TransposeKernel selectKernel(size_t pixelSize)
+{
+	const KernelLevel level = getKernelLevel();
+#ifdef NETPBM_X86
+	if (pixelSize == 1)
+	{
+		if (level >= avx2Level)
+		{
+			return { transposeBlock1AVX2, 16, 32 };
+		}
+		if (level >= sse2Level)
+		{
+			return { transposeBlock1SSE2, 16, 16 };
+		}
+	}
+	else if (pixelSize == 3)
+	{
+		if (level >= avx2Level)
+		{
+			return { transposeBlock3AVX2, 4, 8 };
+		}
+		if (level >= ssse3Level)
+		{
+			return { transposeBlock3SSSE3, 4, 4 };
+		}
+	}
+#else
+	(void)level;
+#endif
+	switch (pixelSize)
+	{
+	case 1:
+		return { transposeBlockScalar<1>, 8, 8 };
+	case 2:
+		return { transposeBlockScalar<2>, 8, 8 };
+	case 3:
+		return { transposeBlockScalar<3>, 8, 8 };
+	case 6:
+		return { transposeBlockScalar<6>, 8, 8 };
+	default:
+		return { nullptr, 0, 0 };
+	}
+}
+
+void transpose(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height, size_t pixelSize)
+{
+	const TransposeKernel kernel = selectKernel(pixelSize);
+	if (kernel.kernel == nullptr)
+	{
+		transposePixels(src, srcStride, dst, dstStride, width, height, pixelSize);
+		return;
+	}
+
+	const ptrdiff_t pixel = (ptrdiff_t)pixelSize;
+	for (size_t tileRow = 0; tileRow < height; tileRow += tileSize)
+	{
+		const size_t rows = height - tileRow < tileSize ? height - tileRow : tileSize;
+		const size_t fullRows = rows - rows % kernel.blockRows;
+		for (size_t tileCol = 0; tileCol < width; tileCol += tileSize)
+		{
+			const size_t cols = width - tileCol < tileSize ? width - tileCol : tileSize;
+			const size_t fullCols = cols - cols % kernel.blockCols;
+			const unsigned char* tileSrc = src + (ptrdiff_t)tileRow * srcStride + (ptrdiff_t)tileCol * pixel;
+			unsigned char* tileDst = dst + (ptrdiff_t)tileCol * dstStride + (ptrdiff_t)tileRow * pixel;
+
+			for (size_t row = 0; row < fullRows; row += kernel.blockRows)
+			{
+				for (size_t col = 0; col < fullCols; col += kernel.blockCols)
+				{
+					kernel.kernel(tileSrc + (ptrdiff_t)row * srcStride + (ptrdiff_t)col * pixel, srcStride,
+						tileDst + (ptrdiff_t)col * dstStride + (ptrdiff_t)row * pixel, dstStride);
+				}
+			}
+			// The columns on the right of the last full block and the rows below it
+			if (fullCols < cols)
+			{
+				transposePixels(tileSrc + (ptrdiff_t)fullCols * pixel, srcStride, tileDst + (ptrdiff_t)fullCols * dstStride, dstStride,
+					cols - fullCols, fullRows, pixelSize);
+			}
+			if (fullRows < rows)
+			{
+				transposePixels(tileSrc + (ptrdiff_t)fullRows * srcStride, srcStride, tileDst + (ptrdiff_t)fullRows * pixel, dstStride,
+					cols, rows - fullRows, pixelSize);
+			}
+		}
+	}
+}
+
+void transposeNaive(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height, size_t pixelSize)
+{
+	// Every destination row is filled by walking down one column of the source
+	for (size_t col = 0; col < width; col++)
+	{
+		unsigned char* dstPixel = dst + (ptrdiff_t)col * dstStride;
+		const unsigned char* srcPixel = src + col * pixelSize;
+		for (size_t row = 0; row < height; row++, srcPixel += srcStride, dstPixel += pixelSize)
+		{
+			std::memcpy(dstPixel, srcPixel, pixelSize);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+
+/* Rotating an image by 90 degrees comes down to transposing its pixels. Walking the columns of a large
+image one pixel at a time touches a different cache line (and often a different memory page) for every
+pixel, so the transpose engine instead works on small square tiles that fit in the cache. Inside a tile,
+blocks of pixels are transposed in registers with SIMD shuffles when the processor supports them. */
+
+// Transposes a block of width x height pixels, each of them pixelSize bytes long: the pixel in row r
+// and column c of the source is written to row c and column r of the destination. The strides are
+// the distances between two rows in bytes. They can be negative, which is how the rotations are built:
+// a destination that starts at its last row and has a negative stride gives a rotation to the left,
+// and a source that starts at its last row and has a negative stride gives a rotation to the right.
+void transpose(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height, size_t pixelSize);
+
+// The same transformation done by walking the source one column at a time. It is kept as a reference
+// for the benchmark and for checking the results of the tiled version.
+void transposeNaive(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dst, ptrdiff_t dstStride,
+	size_t width, size_t height, size_t pixelSize);
@@ -0,0 +1,247 @@
+#include "Writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// The decimal digits of every byte value, padded so that they can be copied with one move. The digits of
+	// 16-bit values are written into the same structure, so it has room for five of them.
+	struct Digits
+	{
+		char characters[8];
+		unsigned length;
+	};
+
+	struct DigitTable
+	{
+		Digits values[256];
+
+		DigitTable()
+		{
+			for (unsigned i = 0; i < 256; i++)
+			{
+				std::memset(this->values[i].characters, 0, 8);
+				this->values[i].length = (unsigned)(std::to_chars(this->values[i].characters, this->values[i].characters + 8, i).ptr - this->values[i].characters);
+			}
+		}
+	};
+
+	const DigitTable digitTable;
+
+	bool writeAll(int descriptor, const char* data, size_t count)
+	{
+		while (count > 0)
+		{
+#if defined(_WIN32)
+			const int written = _write(descriptor, data, (unsigned)std::min(count, (size_t)1 << 30));
+#else
+			const ssize_t written = ::write(descriptor, data, count);
+#endif
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			data += written;
+			count -= (size_t)written;
+		}
+		return true;
+	}
+}
+
+// The buffer has a few spare bytes at the end, because the digits of a value are always copied as four bytes
+Writer::Writer() : buffer(bufferSize + 8), used(0), column(0), descriptor(-1), ownsDescriptor(false), memory(nullptr), failed(false)
+{
+}
+
+Writer::~Writer()
+{
+	close();
+}
+
+bool Writer::open(const std::string& filePath)
+{
+	close();
+#if defined(_WIN32)
+	this->descriptor = _open(filePath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+	this->descriptor = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+	this->ownsDescriptor = this->descriptor >= 0;
+	return this->descriptor >= 0;
+}
+
+void Writer::open(int fileDescriptor)
+{
+	close();
+	this->descriptor = fileDescriptor;
+}
+
+void Writer::open(std::vector<char>& output)
+{
+	close();
+	this->memory = &output;
+}
+
+bool Writer::close()
+{
+	flush();
+	if (this->ownsDescriptor)
+	{
+#if defined(_WIN32)
+		this->failed = _close(this->descriptor) != 0 || this->failed;
+#else
+		this->failed = ::close(this->descriptor) != 0 || this->failed;
+#endif
+	}
+	const bool succeeded = !this->failed;
+	this->descriptor = -1;
+	this->ownsDescriptor = false;
+	this->memory = nullptr;
+	this->failed = false;
+	this->column = 0;
+	return succeeded;
+}
+
+void Writer::flush()
+{
+	if (this->used == 0)
+	{
+		return;
+	}
+	if (this->memory != nullptr)
+	{
+		this->memory->insert(this->memory->end(), this->buffer.data(), this->buffer.data() + this->used);
+	}
+	else if (this->descriptor >= 0 && !this->failed)
+	{
+		this->failed = !writeAll(this->descriptor, this->buffer.data(), this->used);
+	}
+	this->used = 0;
+}
+
+void Writer::put(char c)
+{
+	reserve(1);
+	this->buffer[this->used++] = c;
+	this->column = c == '\n' ? 0 : this->column + 1;
+}
+
+void Writer::write(const void* data, size_t count)
+{
+	// Large blocks, such as whole raw rasters, do not go through the buffer
+	if (count >= bufferSize)
+	{
+		flush();
+		if (this->memory != nullptr)
+		{
+			this->memory->insert(this->memory->end(), (const char*)data, (const char*)data + count);
+		}
+		else if (this->descriptor >= 0 && !this->failed)
+		{
+			this->failed = !writeAll(this->descriptor, (const char*)data, count);
+		}
+		return;
+	}
+	reserve(count);
+	std::memcpy(this->buffer.data() + this->used, data, count);
+	this->used += count;
+}
+
+void Writer::writeNumber(unsigned value)
+{
+	reserve(10);
+	char* dst = this->buffer.data() + this->used;
+	const size_t length = std::to_chars(dst, dst + 10, value).ptr - dst;
+	this->used += length;
+	this->column += length;
+}
+
+void Writer::endLine()
+{
+	put('\n');
+}
+
+// Every value takes at most four bytes (a separator and three digits), so the free space in the buffer is
+// checked once for a whole group of values instead of once per value.
+void Writer::writeNumbers(const unsigned char* src, size_t count, size_t step)
+{
+	writeValues(src, count, step);
+}
+
+void Writer::writeNumbers(const unsigned short* src, size_t count, size_t step)
+{
+	writeValues(src, count, step);
+}
+
+template <typename Sample>
+void Writer::writeValues(const Sample* src, size_t count, size_t step)
+{
+	// At most 3 or 5 digits and a separator are written for every value, and the digits are always
+	// copied as 8 bytes, so 8 bytes at the end of the buffer are left free.
+	const size_t maxLength = sizeof(Sample) == 1 ? 4 : 6;
+	while (count > 0)
+	{
+		reserve(4 * 1024);
+		const size_t groupSize = std::min(count, (this->buffer.size() - 8 - this->used) / maxLength);
+		char* dst = this->buffer.data() + this->used;
+		size_t column = this->column;
+		for (size_t i = 0; i < groupSize; i++, src += step)
+		{
+			Digits digits = digitTable.values[*src & 0xFF];
+			if (sizeof(Sample) > 1 && *src > 255)
+			{
+				digits.length = (unsigned)(std::to_chars(digits.characters, digits.characters + 5, (unsigned)*src).ptr - digits.characters);
+			}
+			if (column != 0)
+			{
+				// The separator becomes a line break when the value would not fit into the line
+				const bool wrap = column + 1 + digits.length > maxLineLength;
+				*dst++ = wrap ? '\n' : ' ';
+				column = wrap ? 0 : column + 1;
+			}
+			std::memcpy(dst, digits.characters, sizeof(digits.characters));
+			dst += digits.length;
+			column += digits.length;
+		}
+		this->used = dst - this->buffer.data();
+		this->column = column;
+		count -= groupSize;
+	}
+}
+
+void Writer::writeBits(const unsigned char* src, size_t count)
+{
+	size_t bit = 0;
+	while (count > 0)
+	{
+		reserve(4 * 1024);
+		const size_t groupSize = std::min(count, (this->buffer.size() - 8 - this->used) / 2);
+		char* dst = this->buffer.data() + this->used;
+		size_t column = this->column;
+		for (size_t i = 0; i < groupSize; i++, bit++)
+		{
+			if (column == maxLineLength)
+			{
+				*dst++ = '\n';
+				column = 0;
+			}
+			*dst++ = (char)('0' + ((src[bit / 8] >> (7 - bit % 8)) & 1));
+			column++;
+		}
+		this->used = dst - this->buffer.data();
+		this->column = column;
+		count -= groupSize;
+	}
+}
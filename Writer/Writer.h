@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Writes a Netpbm file through one large buffer, which is handed to the operating system in big blocks.
+The values of the plain formats are formatted with a table of the digits of every byte (larger values
+are converted with std::to_chars), so nothing is allocated per value, and the lines are wrapped so that none of them is longer than 70 characters, as
+the Netpbm documentation recommends. The output can be a file (opened by path or given as a descriptor)
+or a vector of bytes in memory. */
+
+class Writer
+{
+private:
+	std::vector<char> buffer;
+	size_t used;                // The number of bytes in the buffer that have not been written yet
+	size_t column;              // The length of the current line of text
+	int descriptor;             // The file descriptor the data goes to, or -1 when writing to memory
+	bool ownsDescriptor;        // True when the file was opened by the writer, so it has to close it too
+	std::vector<char>* memory;  // The vector the data is appended to when writing to memory
+	bool failed;                // True after a write to the file has failed
+
+public:
+	Writer();
+	~Writer();
+	Writer(const Writer&) = delete;
+	Writer& operator=(const Writer&) = delete;
+
+	bool open(const std::string& filePath); // Creates (or truncates) the file
+	void open(int fileDescriptor);         // Writes to a descriptor that stays open after close
+	void open(std::vector<char>& output);  // Appends to the vector
+	bool close(); // Flushes the buffer. Returns false if anything could not be written.
+
+	void put(char c);
+	void write(const void* data, size_t count);
+	void writeNumber(unsigned value); // Any number, for example in the header, without a separator
+	void endLine();
+
+	// Writes count values of src, taking every step-th value, separated by spaces and wrapped at 70 columns
+	void writeNumbers(const unsigned char* src, size_t count, size_t step);
+	void writeNumbers(const unsigned short* src, size_t count, size_t step); // The values of 16-bit images
+	// The values of plain .pbm files are single digits, which are written without separators. They are
+	// read from a row of bits, starting from the most significant bit of the first byte.
+	void writeBits(const unsigned char* src, size_t count);
+
+private:
+	static const size_t bufferSize = 1 << 20;
+	static const size_t maxLineLength = 70;
+
+	void flush();
+	template <typename Sample>
+	void writeValues(const Sample* src, size_t count, size_t step); // The loop behind both versions of writeNumbers
+	// Makes sure that at least count bytes fit into the buffer
+	void reserve(size_t count)
+	{
+		if (this->buffer.size() - this->used < count)
+		{
+			flush();
+		}
+	}
+};